@@ -25,8 +25,11 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 
+#ifndef PX_BSP_TICKLESS
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
  * FUNCTION: systime_Isr
  *     PXROS-HR Fast Handler Service routine for STM Timer interrupt.
@@ -45,6 +48,198 @@ static void systime_Isr(PxArg_t systime_Reload)
 
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: TicksIdle
+ *     Idle the core until the next interrupt.
+ *     To be called in the background loop of each core.
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+void TicksIdle(void)
+{
+    __asm__ ("wait");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: TicksResume_Hnd
+ *     The tick is never suppressed without PX_BSP_TICKLESS, nothing to do.
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+void TicksResume_Hnd(void)
+{
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: TicksResume
+ *     The tick is never suppressed without PX_BSP_TICKLESS, nothing to do.
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+void TicksResume(void)
+{
+}
+
+#else /* PX_BSP_TICKLESS */
+
+/* ================================================================================================
+ * TICKLESS IDLE
+ * While the background task idles, the tick compare is moved up to PX_BSP_TICKLESS_MAX_IDLE_TICKS
+ * ticks ahead, so the core is not woken for ticks without work. The ticks elapsed meanwhile
+ * are defined at once and the periodic tick is restored by the STM and HrTimer interrupts,
+ * by tasks reading the kernel time through TicksResume, and by the background task once the
+ * core idles again.
+ * The kernel neither exposes its next timeout nor calls back when another interrupt or a
+ * signal from another core makes a task ready. Such a task runs with a stale tick until one
+ * of the above restores it, and kernel timeouts expiring while idle are processed up to
+ * PX_BSP_TICKLESS_MAX_IDLE_TICKS late; lower it for tighter timeouts. HrTimer deadlines and
+ * the global timebase are not affected.
+ * ==============================================================================================*/
+
+#ifndef PX_BSP_TICKLESS_MAX_IDLE_TICKS
+#define PX_BSP_TICKLESS_MAX_IDLE_TICKS    10
+#endif
+
+typedef struct
+{
+    unsigned int reload;        /* STM ticks per kernel tick */
+    unsigned int lastTick;      /* STM value of the last defined kernel tick */
+    unsigned int idle;          /* whether the tick is suppressed */
+} Ticks_T;
+
+static Ticks_T ticks_State[UC_NB_CORES];
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: ticks_CatchUp
+ *     Define all kernel ticks elapsed since the last one and program the compare for the next.
+ *     !! Function must execute on handler level.
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+static void ticks_CatchUp(Ticks_T *ticks, unsigned int coreId)
+{
+    Ifx_STM *const stm = (Ifx_STM *)((unsigned int)&MODULE_STM0 + (0x100 * coreId));
+
+    do
+    {
+        while (bsp_uc_stm_GetChannelCurrentValue(coreId) - ticks->lastTick >= ticks->reload)
+        {
+            ticks->lastTick += ticks->reload;
+            PxTickDefine_Hnd();
+        }
+
+        stm->CMP[0].U = ticks->lastTick + ticks->reload;
+        bsp_uc_stm_ClearChannelIsrFlag(coreId);
+
+        /* The compare only matches on equality, make sure it still lies ahead */
+    } while (bsp_uc_stm_GetChannelCurrentValue(coreId) - ticks->lastTick >= ticks->reload);
+
+    ticks->idle = 0;
+}
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: systime_Isr
+ *     PXROS-HR Fast Handler Service routine for STM Timer interrupt, tickless variant.
+ *     It defines the elapsed ticks and reprograms the STM timer for the next one.
+ * IN:
+ *     systime_Reload : STM ticks for frequency in [Hz] units provided by
+ *                      PXROS-HR Interrupt Prolog.
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+static void systime_Isr(PxArg_t systime_Reload)
+{
+    unsigned int coreId = bsp_uc_core_GetCurrentCore();
+    (void) systime_Reload;
+
+    ticks_CatchUp(&ticks_State[coreId], coreId);
+}
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: ticks_Suspend
+ *     Move the tick compare up to PX_BSP_TICKLESS_MAX_IDLE_TICKS ahead, unless a tick is due.
+ *     !! Function must execute on handler level.
+ * OUT:
+ *     int    : not needed, but required by syntax of _PxHndcall API
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+static int ticks_Suspend(va_list ap)
+{
+    unsigned int coreId = bsp_uc_core_GetCurrentCore();
+    Ticks_T *ticks = &ticks_State[coreId];
+    Ifx_STM *const stm = (Ifx_STM *)((unsigned int)&MODULE_STM0 + (0x100 * coreId));
+    (void) ap;
+
+    if (bsp_uc_stm_IsChannelIsrFlag(coreId))
+        return 0;
+
+    stm->CMP[0].U = ticks->lastTick + PX_BSP_TICKLESS_MAX_IDLE_TICKS * ticks->reload;
+    ticks->idle = 1;
+
+    /* The regular tick may have passed meanwhile and is handled right away */
+    if (bsp_uc_stm_GetChannelCurrentValue(coreId) - ticks->lastTick >= ticks->reload)
+        ticks_CatchUp(ticks, coreId);
+
+    return 0;
+}
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: ticks_Resume
+ *     _PxHndcall wrapper of TicksResume_Hnd.
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+static int ticks_Resume(va_list ap)
+{
+    (void) ap;
+    TicksResume_Hnd();
+    return 0;
+}
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: TicksIdle
+ *     Idle the core until the next interrupt with the tick suppressed, then restore it.
+ *     To be called in the background loop of each core.
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+void TicksIdle(void)
+{
+    _PxHndcall(ticks_Suspend, PxGetId(), 0);
+    __asm__ ("wait");
+    TicksResume();
+}
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: TicksResume_Hnd
+ *     Restore the periodic tick of the current core if it is suppressed, defining the ticks
+ *     elapsed meanwhile. Handlers waking tasks that read the kernel time shall call this first.
+ *     !! Function must execute on handler level.
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+void TicksResume_Hnd(void)
+{
+    unsigned int coreId = bsp_uc_core_GetCurrentCore();
+
+    if (ticks_State[coreId].idle)
+        ticks_CatchUp(&ticks_State[coreId], coreId);
+}
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: TicksResume
+ *     Task level variant of TicksResume_Hnd. Tasks shall call this before reading the kernel
+ *     time, as they may have been made ready while the tick was suppressed; the handler call
+ *     is only made if it is.
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+void TicksResume(void)
+{
+    if (ticks_State[bsp_uc_core_GetCurrentCore()].idle)
+        _PxHndcall(ticks_Resume, PxGetId(), 0);
+}
+
+#endif /* PX_BSP_TICKLESS */
+
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
  * FUNCTION: set_STM_SRC
@@ -108,10 +303,367 @@ void TicksInit(unsigned int hz)
     /* Setup STM time instance to generate interrupts for the given period (ticks)
      * and enable its interrupts
      */
+#ifdef PX_BSP_TICKLESS
+    ticks_State[coreId].reload = systime_Reload;
+    ticks_State[coreId].lastTick = bsp_uc_stm_GetChannelCurrentValue(coreId);
+#endif
     bsp_uc_stm_ReloadChannel(coreId, bsp_uc_stm_GetChannelCurrentValue(coreId) + systime_Reload);
     bsp_uc_stm_EnableChannelIsr(coreId);
 }
 
+/* ================================================================================================
+ * GLOBAL TIMEBASE
+ * Timestamps in the domain of STM0, comparable across cores at STM resolution.
+ * Each core reads its own STM, the one in the memory regions of its tasks, and corrects it
+ * by the offset to STM0 measured at boot. The STMs share clock and reset, so the offsets are
+ * expected to be within a few STM ticks; the calibration makes sure of it.
+ * ==============================================================================================*/
+
+static long long timebase_Offset[UC_NB_CORES];
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: stm_Local
+ *     STM module of the current core.
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+static Ifx_STM *stm_Local(void)
+{
+    return (Ifx_STM *)((unsigned int)&MODULE_STM0 + (0x100 * bsp_uc_core_GetCurrentCore()));
+}
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: stm_Now
+ *     Read the 64-bit STM value; the upper half is read again in case the lower one wrapped.
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+static unsigned long long stm_Now(Ifx_STM *stm)
+{
+    unsigned int high, low;
+
+    do
+    {
+        high = stm->TIM6.U;
+        low = stm->TIM0.U;
+    } while (high != stm->TIM6.U);
+
+    return ((unsigned long long) high << 32) | low;
+}
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: timebase_Calibrate
+ *     Measure the offset of the current core's STM to STM0: STM0 is read before and after the
+ *     local STM and the local value is compared to the midpoint.
+ *     !! Function must execute in Supervisor privileged level.
+ * OUT:
+ *     int    : not needed, but required by syntax of _PxHndcall API
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+static int timebase_Calibrate(va_list ap)
+{
+    unsigned int coreId = bsp_uc_core_GetCurrentCore();
+    Ifx_STM *stm = stm_Local();
+    unsigned long long before, local, after;
+    (void) ap;
+
+    if (stm == &MODULE_STM0)
+    {
+        timebase_Offset[coreId] = 0;
+        return 0;
+    }
+
+    before = stm_Now(&MODULE_STM0);
+    local = stm_Now(stm);
+    after = stm_Now(&MODULE_STM0);
+
+    timebase_Offset[coreId] = (long long)(local - (before + (after - before) / 2));
+    return 0;
+}
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: TimebaseInit
+ *     Calibrate the global timebase on the current core.
+ *     Must be called once per core before any timestamps are taken.
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+void TimebaseInit(void)
+{
+    _PxHndcall(timebase_Calibrate, PxGetId(), 0);
+}
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: TimebaseNow
+ *     Current time of the global timebase; reads the STM of the current core.
+ * OUT:
+ *     unsigned long long : STM0 ticks since reset
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+unsigned long long TimebaseNow(void)
+{
+    unsigned int coreId = bsp_uc_core_GetCurrentCore();
+
+    return stm_Now(stm_Local()) - timebase_Offset[coreId];
+}
+
+
+/* ================================================================================================
+ * HIGH RESOLUTION TIMERS
+ * One-shot timers on the compare channel 1 of the core's STM, independent of the PXROS tick.
+ * Each core keeps a queue of pending timers sorted by deadline, the compare channel is
+ * programmed for the earliest one. The queue is only accessed on handler level, by the compare
+ * ISR and through _PxHndcall, so they do not need further locking.
+ * Deadlines are given in the global timebase and converted to the core's STM on insertion.
+ * ==============================================================================================*/
+
+typedef struct
+{
+    unsigned long long deadline;
+    PxTask_t task;
+    PxEvents_t events;
+    unsigned int id;
+} HrTimer_T;
+
+typedef struct
+{
+    HrTimer_T timers[HRTIMER_QUEUE_SIZE];   /* sorted by deadline, earliest first */
+    unsigned int count;
+    unsigned int lastId;
+} HrTimerQueue_T;
+
+static HrTimerQueue_T hrtimer_Queues[UC_NB_CORES];
+
+/* Compare values are 32 bits wide; later deadlines are approached in steps of this size */
+#define HRTIMER_MAX_STEP          0x40000000ull
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: hrtimer_Schedule
+ *     Signal all expired timers of the queue and program the compare channel for the earliest
+ *     pending one. A deadline passing while the channel is programmed is detected by reading
+ *     the timer again, so no interrupt is lost.
+ *     !! Function must execute on handler level.
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+static void hrtimer_Schedule(HrTimerQueue_T *queue, Ifx_STM *stm)
+{
+    unsigned int expired;
+    unsigned long long now, target;
+
+    for (;;)
+    {
+        now = stm_Now(stm);
+
+        for (expired = 0; expired < queue->count && queue->timers[expired].deadline <= now; expired++)
+        {
+            PxTaskSignalEvents_Hnd(queue->timers[expired].task, queue->timers[expired].events);
+        }
+
+        if (expired > 0)
+        {
+            queue->count -= expired;
+            memmove(&queue->timers[0], &queue->timers[expired], queue->count * sizeof(HrTimer_T));
+        }
+
+        if (queue->count == 0)
+        {
+            stm->ICR.B.CMP1EN = 0;
+            return;
+        }
+
+        target = queue->timers[0].deadline;
+        if (target - now > HRTIMER_MAX_STEP)
+            target = now + HRTIMER_MAX_STEP;
+
+        stm->CMP[1].U = (unsigned int) target;
+        stm->ISCR.B.CMP1IRR = 1;
+        stm->ICR.B.CMP1EN = 1;
+
+        /* The compare only matches on equality, make sure the target still lies ahead */
+        if (stm_Now(stm) < target)
+            return;
+    }
+}
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: hrtimer_Isr
+ *     PXROS-HR Fast Handler Service routine for the STM compare channel 1 interrupt.
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+static void hrtimer_Isr(PxArg_t arg)
+{
+    (void) arg;
+    TicksResume_Hnd();
+    hrtimer_Schedule(&hrtimer_Queues[bsp_uc_core_GetCurrentCore()], stm_Local());
+}
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: hrtimer_Setup
+ *     Route the compare channel 1 of the core's STM to its second service request and configure
+ *     a 32-bit compare; the channel stays disabled until a timer is started.
+ *     !! Function must execute in Supervisor privileged level.
+ * IN:
+ *     coreId : core servicing the interrupt
+ *     prio   : priority to register
+ * OUT:
+ *     int    : not needed, but required by syntax of _PxHndcall API
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+static int hrtimer_Setup(va_list ap)
+{
+    unsigned int coreId = va_arg(ap, unsigned int);
+    unsigned int prio = va_arg(ap, unsigned int);
+    Ifx_STM *stm = stm_Local();
+    Ifx_SRC *const module_src = (Ifx_SRC *) &MODULE_SRC;
+
+    stm->ICR.B.CMP1EN = 0;
+    stm->CMCON.B.MSTART1 = 0;
+    stm->CMCON.B.MSIZE1 = 31;
+    stm->ICR.B.CMP1OS = 1;
+    stm->ISCR.B.CMP1IRR = 1;
+
+    /* Convert CoreId to correct TOS ID - see TC3x architecture */
+    module_src->STM.STM[coreId].SR[1].B.TOS = (coreId != 0) ? coreId + 1 : 0;
+    module_src->STM.STM[coreId].SR[1].B.SRPN = prio;
+    module_src->STM.STM[coreId].SR[1].B.SRE = 1;
+
+    return 0;
+}
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: hrtimer_Insert
+ *     Insert a timer into the queue of the current core, keeping it sorted.
+ *     !! Function must execute on handler level.
+ * IN:
+ *     timer : timer to insert, its id is assigned here
+ * OUT:
+ *     int   : the id of the timer, 0 if the queue is full
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+static int hrtimer_Insert(va_list ap)
+{
+    HrTimer_T *timer = va_arg(ap, HrTimer_T *);
+    HrTimerQueue_T *queue = &hrtimer_Queues[bsp_uc_core_GetCurrentCore()];
+    unsigned int index;
+
+    if (queue->count == HRTIMER_QUEUE_SIZE)
+        return 0;
+
+    /* Ids are never 0 and encode the core, so cancelling on another core has no effect */
+    queue->lastId = (queue->lastId + 1) & 0x3FFFFFFF;
+    if (queue->lastId == 0)
+        queue->lastId = 1;
+    timer->id = (bsp_uc_core_GetCurrentCore() << 30) | queue->lastId;
+    timer->deadline += timebase_Offset[bsp_uc_core_GetCurrentCore()];
+
+    for (index = queue->count; index > 0 && queue->timers[index - 1].deadline > timer->deadline; index--)
+        queue->timers[index] = queue->timers[index - 1];
+    queue->timers[index] = *timer;
+    queue->count++;
+
+    /* Only a new earliest deadline changes the compare value */
+    if (index == 0)
+        hrtimer_Schedule(queue, stm_Local());
+
+    return (int) timer->id;
+}
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: hrtimer_Remove
+ *     Remove a pending timer from the queue of the current core.
+ *     !! Function must execute on handler level.
+ * IN:
+ *     id  : id of the timer
+ * OUT:
+ *     int : not needed, but required by syntax of _PxHndcall API
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+static int hrtimer_Remove(va_list ap)
+{
+    unsigned int id = va_arg(ap, unsigned int);
+    HrTimerQueue_T *queue = &hrtimer_Queues[bsp_uc_core_GetCurrentCore()];
+    unsigned int index;
+
+    for (index = 0; index < queue->count; index++)
+    {
+        if (queue->timers[index].id == id)
+        {
+            queue->count--;
+            memmove(&queue->timers[index], &queue->timers[index + 1], (queue->count - index) * sizeof(HrTimer_T));
+
+            /* The channel keeps the old compare value; a spurious interrupt reschedules */
+            break;
+        }
+    }
+
+    return 0;
+}
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: HrTimerInit
+ *     Initialization of the high resolution timer service of the current core.
+ *     Must be called once per core, from a task with the right to install handlers.
+ *     The compare channel is only routed once its handler is installed.
+ * OUT:
+ *     PxError_t : error of installing the interrupt handler, PXERR_NOERROR on success
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+PxError_t HrTimerInit(void)
+{
+    unsigned int coreId = bsp_uc_core_GetCurrentCore();
+    PxError_t err;
+
+    err = PxIntInstallFastContextHandler(HRTIMER_ISR_PRIO, hrtimer_Isr, (PxArg_t) 0);
+    if (err != PXERR_NOERROR)
+        return err;
+
+    _PxHndcall(hrtimer_Setup, PxGetId(), 2 * sizeof(unsigned int), coreId, HRTIMER_ISR_PRIO);
+    return PXERR_NOERROR;
+}
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: HrTimerStart
+ *     Start a one-shot timer on the current core; deadlines already passed are signalled
+ *     right away.
+ * IN:
+ *     deadline : time of the global timebase to signal the events at
+ *     task     : task to signal the events to
+ *     events   : events to signal
+ * OUT:
+ *     unsigned int : id of the timer for HrTimerCancel, 0 if too many timers are pending
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+unsigned int HrTimerStart(unsigned long long deadline, PxTask_t task, PxEvents_t events)
+{
+    HrTimer_T timer = { deadline, task, events, 0 };
+
+    return (unsigned int) _PxHndcall(hrtimer_Insert, PxGetId(), sizeof(HrTimer_T *), &timer);
+}
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: HrTimerCancel
+ *     Cancel a timer started on the current core; cancelling an expired timer has no effect.
+ *     Its events may have been signalled already.
+ * IN:
+ *     id : id returned by HrTimerStart
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+void HrTimerCancel(unsigned int id)
+{
+    _PxHndcall(hrtimer_Remove, PxGetId(), sizeof(unsigned int), id);
+}
+
+
 void PxPanic(void)
 {
     extern void exit(int);
@@ -19,7 +19,20 @@
 
 #include "bsp.h"
 
+/* Number of high resolution timers that can be pending at the same time on each core */
+#define HRTIMER_QUEUE_SIZE        16
+
 extern void TicksInit(unsigned int hz);
+extern void TicksIdle(void);
+extern void TicksResume_Hnd(void);
+extern void TicksResume(void);
+
+extern void TimebaseInit(void);
+extern unsigned long long TimebaseNow(void);
+
+extern PxError_t HrTimerInit(void);
+extern unsigned int HrTimerStart(unsigned long long deadline, PxTask_t task, PxEvents_t events);
+extern void HrTimerCancel(unsigned int id);
 
 
 #endif /* __PX_BSP_H__ */
@@ -78,6 +78,13 @@ void InitTask_Func (PxTask_t myID, PxMbx_t myMailbox, PxEvents_t myActivationEve
      */
     TicksInit(1000);
 
+    /* Calibrate the timebase shared by all cores, see TimebaseNow */
+    TimebaseInit();
+
+    /* Start the high resolution timer service on the second STM compare channel */
+    if (HrTimerInit() != PXERR_NOERROR)
+        PxPanic();
+
     /* Create Name Server service task on MASTER_CORE
      * ---------------------------------------------
      * Name Server allows the tasks to exchange data that are not known before
@@ -118,8 +125,10 @@ void InitTask_Func (PxTask_t myID, PxMbx_t myMailbox, PxEvents_t myActivationEve
      */
     PxTaskSetPrio (myID, INITTASK_POSTINIT_PRIO);
 
-    /* Infinitive loop on all cores as background activity */
-    while(1) {__asm__ ("wait");}
+    /* Infinitive loop on all cores as background activity, idling the core
+     * with the kernel tick suppressed if PX_BSP_TICKLESS is defined
+     */
+    while(1) {TicksIdle();}
 }
 
 
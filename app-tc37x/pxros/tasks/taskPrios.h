@@ -29,6 +29,7 @@
  * ==============================================================================================*/
 
 #define SYSTIME_ISR_PRIO          2
+#define HRTIMER_ISR_PRIO          3
 #define GETH_ISR_PRIO             10
 
 
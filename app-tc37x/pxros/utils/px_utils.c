@@ -52,14 +52,9 @@ PxError_t HtcPxNameQuery (PxNameId_t Id, PxSize_t infosize, void *info, int retr
     if (retryCount == 0)
         retryCount = NAMEQUERY_RETRY_DEFAULT;
 
-    /* ask for a timeout object from the task default object pool to generate wake-up event */
-    PxTo_t to = PxToRequest(PXOpoolTaskdefault, retryTimeout, retryEvent);
-
-    if (PxToIdError(to) != PXERR_NOERROR)
-    {
-        err = PxToIdError(to);
-        return err;
-    }
+    /* the timeout object generating the wake-up event is only requested if a retry is needed */
+    HtcDelay_t delay;
+    HtcDelayInit(&delay, retryEvent);
 
     /* Mark object as invalid before its use */
     *((PxObj_t *)info) = PxObjIdInvalidate();
@@ -76,8 +71,9 @@ PxError_t HtcPxNameQuery (PxNameId_t Id, PxSize_t infosize, void *info, int retr
         {
             if (err == PXERR_NAME_UNDEFINED)
             {
-                PxToStart(to);
-                PxAwaitEvents(retryEvent);
+                err = HtcDelaySleep(&delay, retryTimeout);
+                if (err != PXERR_NOERROR)
+                    break;
             }
             else
                 break;
@@ -91,8 +87,7 @@ PxError_t HtcPxNameQuery (PxNameId_t Id, PxSize_t infosize, void *info, int retr
         err =  PXERR_NAME_UNDEFINED;
 
     /* Stop and release the temporary timeout object */
-    PxToStop(to);
-    PxToRelease(to);
+    HtcDelayRelease(&delay);
 
     return err;
 }
@@ -102,6 +97,7 @@ PxError_t HtcPxNameQuery (PxNameId_t Id, PxSize_t infosize, void *info, int retr
  * FUNCTION: HtcSleep
  *     Sleep a task for arbitrary number of px ticks
  *     Function utilizes a temporary Timeout object taken from a Caller Task default object pool.
+ *     Tasks sleeping repeatedly shall keep a HtcDelay_t instead, see HtcDelaySleep.
  * IN:
  *     timeout        : timeout defined in PX Ticks
  *     taskSleepEvent : Caller task event to use to signal end
@@ -117,21 +113,105 @@ PxError_t HtcPxNameQuery (PxNameId_t Id, PxSize_t infosize, void *info, int retr
 
 PxError_t HtcSleep (PxTicks_t timeout, PxEvents_t taskSleepEvent)
 {
-    if (timeout)
+    HtcDelay_t delay;
+    HtcDelayInit(&delay, taskSleepEvent);
+
+    PxError_t err = HtcDelaySleep(&delay, timeout);
+    PxError_t releaseErr = HtcDelayRelease(&delay);
+
+    return (err != PXERR_NOERROR) ? err : releaseErr;
+}
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: HtcDelayInit
+ *     Prepare a reusable delay of the caller task; no kernel object is requested yet.
+ *     The delay shall be kept by the task, e.g. as a local variable of its task function,
+ *     and be released by HtcDelayRelease once not needed anymore.
+ * IN:
+ *     delay          : delay to prepare
+ *     taskSleepEvent : Caller task event to use to signal end
+ *                      of timeout object expiration
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+void HtcDelayInit (HtcDelay_t *delay, PxEvents_t taskSleepEvent)
+{
+    delay->to = PxToIdInvalidate();
+    delay->timeout = 0;
+    delay->event = taskSleepEvent;
+}
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: HtcDelaySleep
+ *     Sleep a task for arbitrary number of px ticks, reusing the Timeout object of the delay.
+ *     The timeout of an object is fixed on request, so the object is requested from the Caller
+ *     Task default object pool on the first sleep and again only if the timeout changes.
+ * IN:
+ *     delay   : delay prepared by HtcDelayInit
+ *     timeout : timeout defined in PX Ticks
+ * OUT:
+ *     PxError_t : PXERR_NOERROR - sleep is over
+ *                 other code    - something went wrong in object allocation
+ *                                 or use
+ * NOTES:
+ *     Same as for HtcSleep, the event of the delay must be dedicated to it.
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+PxError_t HtcDelaySleep (HtcDelay_t *delay, PxTicks_t timeout)
+{
+    if (timeout == 0)
+        return PXERR_NOERROR;
+
+    if (PxToIdIsValid(delay->to) && (delay->timeout != timeout))
+    {
+        PxError_t err = HtcDelayRelease(delay);
+        if (err != PXERR_NOERROR)
+            return err;
+    }
+
+    if (!PxToIdIsValid(delay->to))
     {
-        PxTo_t to = PxToRequest(PXOpoolTaskdefault, timeout, taskSleepEvent);
+        PxTo_t to = PxToRequest(PXOpoolTaskdefault, timeout, delay->event);
         if (PxToIdError(to) != PXERR_NOERROR)
             return PxToIdError(to);
 
-        PxToStart(to);
-        PxEvents_t ev = PxAwaitEvents(taskSleepEvent);
+        delay->to = to;
+        delay->timeout = timeout;
+    }
+
+    /* An expired timeout object is started again */
+    PxToStart(delay->to);
+    PxEvents_t ev = PxAwaitEvents(delay->event);
+
+    if (ev != delay->event)
+        return PXERR_EVENT_ZERO;
+
+    return PXERR_NOERROR;
+}
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * FUNCTION: HtcDelayRelease
+ *     Stop and release the Timeout object of the delay, if any; the delay can be used again.
+ * IN:
+ *     delay : delay prepared by HtcDelayInit
+ * OUT:
+ *     PxError_t : PXERR_NOERROR - object released or not requested yet
+ *                 other code    - something went wrong in object release
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~*/
+
+PxError_t HtcDelayRelease (HtcDelay_t *delay)
+{
+    if (PxToIdIsValid(delay->to))
+    {
+        PxToStop(delay->to);
 
-        to = PxToRelease(to);
+        PxTo_t to = PxToRelease(delay->to);
         if (PxToIdError(to) != PXERR_NOERROR)
             return PxToIdError(to);
 
-        if (ev != taskSleepEvent)
-            return PXERR_EVENT_ZERO;
+        delay->to = PxToIdInvalidate();
     }
 
     return PXERR_NOERROR;
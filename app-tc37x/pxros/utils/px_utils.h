@@ -36,6 +36,19 @@ extern "C" {
 #define NAMEQUERY_RETRY_DEFAULT     10  /* number of trials */
 
 
+/* ================================================================================================
+ * TYPES
+ * ==============================================================================================*/
+
+/* One-shot delay reusing its timeout object across sleeps, see HtcDelaySleep */
+typedef struct
+{
+    PxTo_t to;              /* timeout object, invalid until the first sleep */
+    PxTicks_t timeout;      /* timeout the object was requested with */
+    PxEvents_t event;       /* caller task event signalled at the end of the timeout */
+} HtcDelay_t;
+
+
 /* ================================================================================================
  * API
  * ==============================================================================================*/
@@ -47,6 +60,11 @@ PxError_t HtcPxNameQuery (PxNameId_t Id, PxSize_t infosize, void *info, int retr
 /* Sleep a task for arbitrary number of PXROS ticks */
 PxError_t HtcSleep (PxTicks_t timeout, PxEvents_t taskSleepEvent);
 
+/* Reusable delay: prepare, sleep any number of times, release */
+void HtcDelayInit (HtcDelay_t *delay, PxEvents_t taskSleepEvent);
+PxError_t HtcDelaySleep (HtcDelay_t *delay, PxTicks_t timeout);
+PxError_t HtcDelayRelease (HtcDelay_t *delay);
+
 
 #ifdef __cplusplus
 }
@@ -1,9 +1,8 @@
 //! Some example async functions used by the example.
-use core::task::Poll;
-
 use futures::StreamExt;
 use pxros::bindings::PxError_t;
 use pxros::PxResult;
+use veecle_pxros::executor::budget::yield_now;
 use veecle_pxros::pxros::events::{AsyncEventReceiver, Event};
 use veecle_pxros::pxros::messages::AsyncMessageReceiver;
 use veecle_pxros::pxros::task::log_id;
@@ -16,7 +15,7 @@ impl AsyncExecutorTask {
         let (task_debug_name, current_task_id) = log_id::<Self>();
         for i in 0..10 {
             defmt::info!("[{}: {}] Async task A -> {:?}", task_debug_name, current_task_id, i);
-            Self::yield_once().await;
+            yield_now().await;
         }
         Ok(150)
     }
@@ -25,7 +24,7 @@ impl AsyncExecutorTask {
         let (task_debug_name, current_task_id) = log_id::<Self>();
         for i in 0..10 {
             defmt::info!("[{}: {}] Async task C -> {:?}", task_debug_name, current_task_id, i);
-            Self::yield_once().await;
+            yield_now().await;
         }
 
         Ok(300)
@@ -75,20 +74,4 @@ impl AsyncExecutorTask {
 
         Err(PxError_t::PXERR_EVENT_ZERO)
     }
-
-    /// Yield execution of the current task
-    pub async fn yield_once() {
-        let mut did_yield = false;
-
-        core::future::poll_fn(|cx| {
-            if did_yield {
-                Poll::Ready(())
-            } else {
-                did_yield = true;
-                cx.waker().wake_by_ref();
-                Poll::Pending
-            }
-        })
-        .await;
-    }
 }
@@ -0,0 +1,73 @@
+//! Cooperative scheduling.
+//!
+//! Tasks share the executor by returning [Poll::Pending]; a future which
+//! always finds more work, e.g. a stream with a full queue behind it, would
+//! otherwise never give the other tasks a turn. Every poll of a task is granted
+//! [POLL_BUDGET] units of work; once they are used up, [poll_budget] makes the
+//! task yield back to the executor and the executor reports the exhaustion to
+//! the [RawExecutor](super::RawExecutor), so starving tasks can be found.
+//!
+//! The streams of [crate::pxros] consume one unit per item they return, see
+//! [poll_budgeted]; polls finding no item are free.
+use core::future::poll_fn;
+use core::task::{ready, Context, Poll};
+
+use super::waker::with_generic_context;
+
+/// Units of work a task may do per poll.
+pub const POLL_BUDGET: u16 = 32;
+
+/// Consume one unit of the budget of the current task.
+///
+/// Returns [Poll::Pending] and schedules the task to be polled again if the
+/// budget is exhausted; the caller shall return [Poll::Pending] as well without
+/// doing the work. Tasks not run by an executor of this crate have an unlimited
+/// budget.
+pub fn poll_budget(cx: &Context<'_>) -> Poll<()> {
+    match with_generic_context(|context| context.consume_budget(), cx) {
+        Some(false) => {
+            cx.waker().wake_by_ref();
+            Poll::Pending
+        },
+        _ => Poll::Ready(()),
+    }
+}
+
+/// Poll for an item within the budget of the current task.
+///
+/// One unit is consumed only if `poll` returns an item. If the budget is
+/// exhausted, the task yields as with [poll_budget] without calling `poll`.
+pub fn poll_budgeted<T>(cx: &mut Context<'_>, poll: impl FnOnce(&mut Context<'_>) -> Poll<T>) -> Poll<T> {
+    ready!(poll_budget(cx));
+
+    let item = poll(cx);
+    if item.is_pending() {
+        // No work was done
+        with_generic_context(|context| context.refund_budget(), cx);
+    }
+    item
+}
+
+/// Asynchronously consume one unit of the budget of the current task.
+///
+/// See [poll_budget] for details.
+pub async fn consume_budget() {
+    poll_fn(|cx| poll_budget(cx)).await
+}
+
+/// Yield execution of the current task once, allowing other ready tasks to
+/// be polled before it continues.
+pub async fn yield_now() {
+    let mut yielded = false;
+
+    poll_fn(|cx| {
+        if yielded {
+            Poll::Ready(())
+        } else {
+            yielded = true;
+            cx.waker().wake_by_ref();
+            Poll::Pending
+        }
+    })
+    .await
+}
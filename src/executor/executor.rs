@@ -2,13 +2,17 @@
 //!
 //! This module defines the high-level executor logic. Independent from hardware
 //! specific details the executor actually decides when to poll which tasks.
+use core::cmp::Reverse;
 use core::future::Future;
 use core::pin::Pin;
 use core::task::{Context, Poll};
 
 use heapless::Vec;
 
-use super::task::{Task, TaskStorage};
+use super::budget::POLL_BUDGET;
+use super::pool::{Pool, TaskPool};
+use super::remote::RemoteWake;
+use super::task::{Task, TaskRef, TaskStorage, READY_BLOCK};
 use super::{RawExecutor, TaskContext};
 
 /// A type that can be processed as result from any of the [Executor]
@@ -28,53 +32,142 @@ impl<T, E> TaskResult for Result<T, E> {
     }
 }
 
+/// Priority class of a task.
+///
+/// Whenever tasks of different classes are ready, the executor polls the
+/// higher class first; tasks of the same class are polled in turns.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq, PartialOrd, Ord)]
+pub enum Priority {
+    /// Background work such as logging or diagnostics.
+    Low = 0,
+    /// The class of tasks added without a priority.
+    #[default]
+    Normal = 1,
+    /// Tasks that shall not be delayed by regular work.
+    High = 2,
+    /// Latency critical tasks, e.g. control loops.
+    Critical = 3,
+}
+
+/// Number of [Priority] classes.
+const PRIORITIES: usize = Priority::Critical as usize + 1;
+
 /// A generic executor able to run a fixed number of tasks.
 ///
 /// This structure provides wakers to the tasks and defines execution order and
 /// priority.
 ///
+/// Wakers record their task in the ready word of the task's block (see
+/// [GenericContext](super::task::GenericContext)), so every iteration only polls
+/// the tasks that were actually woken instead of visiting all of them.
+///
+/// Every task has a [Priority]. Tasks are ordered by priority when the executor
+/// starts running; after each poll the executor checks whether a task of a
+/// higher class than the polled one became ready and, if so, polls it next.
+/// The delay between waking a task and polling it is hence bounded by a single
+/// poll of a lower class task, regardless of how many of those are ready.
+///
 /// The trait [RawExecutor] allows upstream users to define efficient logic
 /// when a task is actually ready to be run.
+///
+/// Tasks are stored as trait objects, so tasks of any type can be added at
+/// runtime. When all tasks are known upfront, [StaticExecutor](super::static_executor::StaticExecutor)
+/// avoids the dynamic dispatch.
 pub struct Executor<'a, E: RawExecutor, R, const TASK_COUNT: usize> {
-    #[allow(clippy::type_complexity)]
-    tasks: Vec<(usize, Pin<&'a mut dyn Task<E, R>>), TASK_COUNT>,
+    tasks: Vec<ExecutorTask<'a, E, R>, TASK_COUNT>,
+    contexts: Vec<ExecutorContext<E>, TASK_COUNT>,
     executor: E,
 }
 
+/// A task slot of an [Executor].
+enum ExecutorTask<'a, E: RawExecutor, R> {
+    /// A task added with [Executor::add].
+    Task(Pin<&'a mut dyn Task<E, R>>),
+    /// A slot of a pool added with [Executor::add_pool].
+    Pooled(&'a dyn Pool<R>, usize),
+}
+
+impl<E: RawExecutor, R, const TASK_COUNT: usize> TaskSet<E, R> for Vec<ExecutorTask<'_, E, R>, TASK_COUNT> {
+    fn poll(&mut self, index: usize) -> Poll<R> {
+        match &mut self[index] {
+            ExecutorTask::Task(task) => task.as_mut().poll(),
+            // SAFETY: The pool was registered with this executor.
+            ExecutorTask::Pooled(pool, slot) => unsafe { pool.poll(*slot) },
+        }
+    }
+
+    fn is_pooled(&self, index: usize) -> bool {
+        matches!(self[index], ExecutorTask::Pooled(..))
+    }
+
+    fn pools_idle(&self) -> bool {
+        self.iter().all(|task| match task {
+            ExecutorTask::Task(_) => true,
+            ExecutorTask::Pooled(pool, slot) => !pool.is_running(*slot),
+        })
+    }
+}
+
 impl<'a, E: RawExecutor, R: 'static, const TASK_COUNT: usize> Executor<'a, E, R, TASK_COUNT>
 where
     R: 'static,
     R: TaskResult,
 {
-    /// Allows us to create an array of unset values even
-    /// if no value of R is known and R is not clone.
-    const EMPTY: Option<R> = None;
-
     /// Creates a new instance.
     pub fn new(executor: E) -> Self {
         Executor {
             tasks: Vec::new(),
+            contexts: Vec::new(),
             executor,
         }
     }
 
-    /// Add a task to be run in this executor.
+    /// Add a task to be run in this executor with [Priority::Normal].
     ///
     /// # Panics
     /// This function panics if the executor is full.
     pub fn add<F>(&mut self, task: &'static mut TaskStorage<F, E>)
+    where
+        F: Future<Output = R>,
+    {
+        self.add_with_priority(task, Priority::Normal)
+    }
+
+    /// Add a task to be run in this executor with the given priority.
+    ///
+    /// # Panics
+    /// This function panics if the executor is full.
+    pub fn add_with_priority<F>(&mut self, task: &'static mut TaskStorage<F, E>, priority: Priority)
     where
         F: Future<Output = R>,
     {
         let local_context = self.executor.new_context();
-        let task = task.init(local_context);
+        let task = Pin::static_mut(task.init(local_context));
 
-        task.waker_context().mark_ready();
+        add_context(&mut self.contexts, task.task_ref(), priority);
+        // Cannot fail, there is a context for every task
+        let _ = self.tasks.push(ExecutorTask::Task(task));
+    }
 
-        self.tasks
-            .push((self.tasks.len(), Pin::static_mut(task)))
-            .map_err(|_| ())
-            .expect("Executor has no space left for a new task")
+    /// Add the slots of a task pool to this executor; futures spawned into the
+    /// pool are run by this executor.
+    ///
+    /// Every slot takes the place of a task with [Priority::Normal]: the executor
+    /// must have space for all of them, and their entry in the results of
+    /// [Executor::run] is always empty.
+    ///
+    /// # Panics
+    /// This function panics if the executor is full, or if the pool was already
+    /// added to an executor.
+    pub fn add_pool<F, const POOL_SIZE: usize>(&mut self, pool: &'static TaskPool<F, E, POOL_SIZE>)
+    where
+        F: Future<Output = R>,
+    {
+        for (slot, context) in pool.register(&self.executor).enumerate() {
+            add_context(&mut self.contexts, context, Priority::Normal);
+            // Cannot fail, there is a context for every task
+            let _ = self.tasks.push(ExecutorTask::Pooled(pool, slot));
+        }
     }
 
     /// Run until either all tasks in the executor have finished or return early
@@ -83,38 +176,7 @@ where
     ///
     /// This method relies on the implementation of [RawExecutor::wait].
     pub fn run(mut self) -> [Option<R>; TASK_COUNT] {
-        // Prepare a mutable array where to store the return types; could
-        // be none if the task *fails* without returning
-        let mut results = [Self::EMPTY; TASK_COUNT];
-
-        loop {
-            self.tasks.retain_mut(|(index, task)| {
-                if task.waker_context().clear_ready() {
-                    // In case the task completes, store in the correct array index
-                    // it's result
-                    match task.as_mut().poll() {
-                        Poll::Pending => true,
-                        Poll::Ready(r) => {
-                            results[*index] = Some(r);
-                            false
-                        },
-                    }
-                } else {
-                    true
-                }
-            });
-
-            // Check if any task failed and we need to bail or we are done
-            if results.iter().flatten().any(|r| r.bail()) || self.tasks.is_empty() {
-                break;
-            }
-
-            let some_task_ready = self.tasks.iter().any(|task| task.1.waker_context().is_ready());
-
-            self.executor.wait(self.tasks.as_mut(), !some_task_ready);
-        }
-
-        results
+        run_tasks(&mut self.executor, &mut self.contexts, &mut self.tasks)
     }
 
     /// Allows access to the current task local data.
@@ -129,24 +191,230 @@ where
     }
 }
 
-impl<'a, E: RawExecutor, R> TaskContext<E> for (usize, Pin<&'a mut dyn Task<E, R>>) {
+/// A task as scheduled by [run_tasks].
+pub(crate) struct ExecutorContext<E: RawExecutor> {
+    task: TaskRef<E>,
+    /// Position of the task in the order the tasks were added.
+    index: usize,
+    priority: Priority,
+    /// Number of polls the task ran out of budget.
+    exhaustions: u32,
+}
+
+impl<E: RawExecutor> TaskContext<E> for ExecutorContext<E> {
     fn local_data(&mut self) -> &mut E::TaskLocalData {
-        self.1.as_mut().local_data()
+        self.task.local_data()
     }
 
     fn mark_ready(&self) {
-        self.1.waker_context().mark_ready()
+        self.task.mark_ready()
+    }
+}
+
+/// Append a new task to the contexts of an executor, marking it ready for its
+/// first poll.
+///
+/// # Panics
+/// This function panics if the executor is full.
+pub(crate) fn add_context<E: RawExecutor, const TASK_COUNT: usize>(
+    contexts: &mut Vec<ExecutorContext<E>, TASK_COUNT>,
+    task: TaskRef<E>,
+    priority: Priority,
+) {
+    task.mark_ready();
+
+    let index = contexts.len();
+    contexts
+        .push(ExecutorContext {
+            task,
+            index,
+            priority,
+            exhaustions: 0,
+        })
+        .map_err(|_| ())
+        .expect("Executor has no space left for a new task")
+}
+
+/// Order the tasks by priority and attach each of them to the ready word of its
+/// block and to the remote wake of the executor.
+///
+/// Returns, for every priority class, the number of tasks of a higher class,
+/// which is the position of the first task of the class.
+fn schedule<E: RawExecutor>(
+    contexts: &mut [ExecutorContext<E>],
+    remote: Option<&'static RemoteWake>,
+) -> [usize; PRIORITIES] {
+    contexts.sort_unstable_by_key(|context| (Reverse(context.priority), context.index));
+
+    for position in 0..contexts.len() {
+        let block = contexts[position - position % READY_BLOCK]
+            .task
+            .waker_context()
+            .hosted_block();
+
+        // SAFETY: The ready word is hosted by a task of this executor; all of them
+        // have a `'static` lifetime.
+        unsafe {
+            contexts[position]
+                .task
+                .waker_context()
+                .attach(block, position % READY_BLOCK, remote)
+        };
     }
+
+    let mut higher = [0; PRIORITIES];
+    for context in contexts.iter() {
+        for count in higher[..context.priority as usize].iter_mut() {
+            *count += 1;
+        }
+    }
+
+    higher
+}
+
+/// Check whether any of the tasks before the given position is ready.
+fn ready_before<E: RawExecutor>(contexts: &[ExecutorContext<E>], end: usize) -> bool {
+    (0..end).step_by(READY_BLOCK).any(|block| {
+        let mask = match end - block {
+            bits if bits >= READY_BLOCK => u32::MAX,
+            bits => (1 << bits) - 1,
+        };
+
+        contexts[block].task.waker_context().peek_block() & mask != 0
+    })
+}
+
+/// The tasks of an executor, as seen by [run_tasks].
+///
+/// Indices are the positions of the tasks in the order they were added.
+pub(crate) trait TaskSet<E: RawExecutor, R> {
+    /// Poll the task at the given index.
+    fn poll(&mut self, index: usize) -> Poll<R>;
+
+    /// Check whether the task at the given index is a slot of a [TaskPool].
+    fn is_pooled(&self, index: usize) -> bool;
+
+    /// Check whether none of the pool slots holds a future.
+    fn pools_idle(&self) -> bool;
+}
+
+/// Run loop shared by all executors.
+///
+/// Polls the ready tasks until either all tasks have finished or one of them
+/// finishes with a result where [TaskResult::bail] returns true. Pool slots do
+/// not finish; the loop keeps running as long as any of them holds a future.
+///
+/// The results are stored in the order the tasks were added, while the raw
+/// executor sees the tasks ordered by priority. Every poll starts with a full
+/// [budget](super::budget); exhausting it is reported to the raw executor.
+pub(crate) fn run_tasks<E, R, T, const TASK_COUNT: usize>(
+    executor: &mut E,
+    contexts: &mut [ExecutorContext<E>],
+    tasks: &mut T,
+) -> [Option<R>; TASK_COUNT]
+where
+    E: RawExecutor,
+    R: TaskResult,
+    T: TaskSet<E, R>,
+{
+    // Prepare a mutable array where to store the return types; could
+    // be none if the task *fails* without returning
+    let mut results: [Option<R>; TASK_COUNT] = core::array::from_fn(|_| None);
+    let mut pending = (0..contexts.len()).filter(|index| !tasks.is_pooled(*index)).count();
+    let remote = executor.remote_wake();
+    let higher = schedule(contexts, remote);
+
+    loop {
+        let mut bail = false;
+        let mut next_block = 0;
+
+        while next_block < contexts.len() {
+            let block = next_block;
+            next_block += READY_BLOCK;
+
+            let mut ready = contexts[block].task.waker_context().take_block();
+
+            while ready != 0 {
+                let position = block + ready.trailing_zeros() as usize;
+                let index = contexts[position].index;
+                ready &= ready - 1;
+
+                // Wakers may still be invoked after their task completed
+                if results[index].is_some() {
+                    continue;
+                }
+
+                contexts[position].task.waker_context().reset_budget(POLL_BUDGET);
+
+                // In case the task completes, store in the correct array index
+                // it's result
+                if let Poll::Ready(result) = tasks.poll(index) {
+                    // Reset the local data so the raw executor does not act on
+                    // behalf of a task that is gone
+                    *contexts[position].local_data() = executor.new_context();
+
+                    bail |= result.bail();
+                    // Pool slots are reused, their results are dropped
+                    if !tasks.is_pooled(index) {
+                        results[index] = Some(result);
+                        pending -= 1;
+                    }
+                } else if contexts[position].task.waker_context().budget_exhausted() {
+                    let context = &mut contexts[position];
+                    context.exhaustions = context.exhaustions.saturating_add(1);
+                    executor.budget_exhausted(position, context.exhaustions, context);
+                }
+
+                executor.polled(position, &mut contexts[position]);
+
+                // Tasks of a higher class woken in the meantime go first; the
+                // remaining tasks of this block stay ready
+                let higher = higher[contexts[position].priority as usize];
+                if higher > 0 && ready_before(contexts, higher) {
+                    contexts[block].task.waker_context().restore_block(ready);
+                    next_block = 0;
+                    break;
+                }
+            }
+        }
+
+        // Check if any task failed and we need to bail or we are done
+        if bail || (pending == 0 && tasks.pools_idle()) {
+            break;
+        }
+
+        // Wakeups from outside of the executor interrupt the wait from here on
+        if let Some(remote) = remote {
+            remote.arm();
+        }
+
+        let some_task_ready = (0..contexts.len())
+            .step_by(READY_BLOCK)
+            .any(|block| contexts[block].task.waker_context().peek_block() != 0);
+
+        executor.wait(contexts, !some_task_ready);
+
+        if let Some(remote) = remote {
+            remote.disarm();
+        }
+    }
+
+    results
 }
 
 #[cfg(test)]
 mod tests {
+    extern crate test;
+
     use core::future::{poll_fn, Future};
     use core::pin::Pin;
-    use core::sync::atomic::{AtomicBool, Ordering};
-    use core::task::{Context, Poll};
+    use core::sync::atomic::{AtomicBool, AtomicU32, Ordering};
+    use core::task::{Context, Poll, Waker};
+    use std::sync::Mutex;
 
-    use super::{Executor, RawExecutor};
+    use super::{Executor, Priority, RawExecutor, POLL_BUDGET};
+    use crate::executor::budget::{consume_budget, poll_budgeted, yield_now};
+    use crate::executor::remote::RemoteWake;
     use crate::executor::task::TaskStorage;
 
     struct SimpleExecutor {}
@@ -275,4 +543,299 @@ mod tests {
 
         assert!(DID_FINISH.load(Ordering::Relaxed));
     }
+
+    #[test]
+    fn higher_priority_goes_first() {
+        static POLLS: Mutex<Vec<&str>> = Mutex::new(Vec::new());
+        static CRITICAL: Mutex<Option<Waker>> = Mutex::new(None);
+
+        /// Parks on its first poll and completes once woken.
+        async fn critical() -> Result<(), ()> {
+            let mut parked = false;
+            poll_fn(|cx| {
+                POLLS.lock().unwrap().push("critical");
+                if parked {
+                    return Poll::Ready(Ok(()));
+                }
+                parked = true;
+                *CRITICAL.lock().unwrap() = Some(cx.waker().clone());
+                Poll::Pending
+            })
+            .await
+        }
+
+        /// Yields once; the first one to run wakes the critical task.
+        async fn background(name: &'static str) -> Result<(), ()> {
+            let mut yielded = false;
+            poll_fn(|cx| {
+                POLLS.lock().unwrap().push(name);
+                if yielded {
+                    return Poll::Ready(Ok(()));
+                }
+                yielded = true;
+                if let Some(waker) = CRITICAL.lock().unwrap().take() {
+                    waker.wake()
+                }
+                cx.waker().wake_by_ref();
+                Poll::Pending
+            })
+            .await
+        }
+
+        let mut executor: Executor<'_, SimpleExecutor, Result<(), ()>, 4> = Executor::new(SimpleExecutor::new());
+
+        for name in ["a", "b", "c"] {
+            executor.add_with_priority(Box::leak(Box::new(TaskStorage::new(background(name)))), Priority::Low);
+        }
+        executor.add_with_priority(Box::leak(Box::new(TaskStorage::new(critical()))), Priority::Critical);
+        let results = executor.run();
+
+        assert!(results.iter().all(|result| *result == Some(Ok(()))));
+        // The critical task was added last but runs first, and runs again right
+        // after being woken although the other tasks are still ready.
+        assert_eq!(POLLS.lock().unwrap()[..3], ["critical", "a", "critical"]);
+    }
+
+    #[test]
+    fn greedy_task_yields_on_exhausted_budget() {
+        static EXHAUSTIONS: AtomicU32 = AtomicU32::new(0);
+        static POLLS: Mutex<Vec<&str>> = Mutex::new(Vec::new());
+
+        /// Records the exhaustions reported by the run loop.
+        struct BudgetExecutor;
+
+        impl RawExecutor for BudgetExecutor {
+            type TaskLocalData = ();
+
+            fn wait<C: super::TaskContext<Self>>(&mut self, _: &mut [C], _may_block: bool) {}
+
+            fn budget_exhausted<C: super::TaskContext<Self>>(&mut self, _: usize, exhaustions: u32, _: &mut C) {
+                EXHAUSTIONS.store(exhaustions, Ordering::Relaxed);
+            }
+
+            fn new_context(&self) -> Self::TaskLocalData {}
+        }
+
+        /// Does three budgets worth of work without ever waiting.
+        async fn greedy() -> Result<(), ()> {
+            for _ in 0..3 * POLL_BUDGET {
+                consume_budget().await;
+            }
+            POLLS.lock().unwrap().push("greedy");
+            Ok(())
+        }
+
+        async fn other() -> Result<(), ()> {
+            POLLS.lock().unwrap().push("other");
+            yield_now().await;
+            POLLS.lock().unwrap().push("other");
+            Ok(())
+        }
+
+        let mut executor: Executor<'_, BudgetExecutor, Result<(), ()>, 2> = Executor::new(BudgetExecutor);
+        executor.add(Box::leak(Box::new(TaskStorage::new(greedy()))));
+        executor.add(Box::leak(Box::new(TaskStorage::new(other()))));
+        executor.run();
+
+        // The greedy task yields after each budget, letting the other task
+        // complete before it.
+        assert_eq!(EXHAUSTIONS.load(Ordering::Relaxed), 2);
+        assert_eq!(*POLLS.lock().unwrap(), ["other", "other", "greedy"]);
+    }
+
+    #[test]
+    fn polls_without_items_do_not_consume_budget() {
+        static EXHAUSTED: AtomicBool = AtomicBool::new(false);
+
+        struct BudgetExecutor;
+
+        impl RawExecutor for BudgetExecutor {
+            type TaskLocalData = ();
+
+            fn wait<C: super::TaskContext<Self>>(&mut self, _: &mut [C], _may_block: bool) {}
+
+            fn budget_exhausted<C: super::TaskContext<Self>>(&mut self, _: usize, _: u32, _: &mut C) {
+                EXHAUSTED.store(true, Ordering::Relaxed);
+            }
+
+            fn new_context(&self) -> Self::TaskLocalData {}
+        }
+
+        /// Finds no item many times within a single poll, then one.
+        async fn idle() -> Result<(), ()> {
+            poll_fn(|cx| {
+                for _ in 0..3 * POLL_BUDGET {
+                    assert!(poll_budgeted(cx, |_| Poll::<()>::Pending).is_pending());
+                }
+                poll_budgeted(cx, |_| Poll::Ready(Ok(())))
+            })
+            .await
+        }
+
+        let mut executor: Executor<'_, BudgetExecutor, Result<(), ()>, 1> = Executor::new(BudgetExecutor);
+        executor.add(Box::leak(Box::new(TaskStorage::new(idle()))));
+
+        assert_eq!(executor.run(), [Some(Ok(()))]);
+        assert!(!EXHAUSTED.load(Ordering::Relaxed));
+    }
+
+    #[test]
+    fn remote_wake_interrupts_wait() {
+        static INTERRUPTS: AtomicU32 = AtomicU32::new(0);
+        static REMOTE: RemoteWake = RemoteWake::new(|_| {
+            INTERRUPTS.fetch_add(1, Ordering::Relaxed);
+        });
+
+        /// Blocks until interrupted.
+        struct BlockingExecutor;
+
+        impl RawExecutor for BlockingExecutor {
+            type TaskLocalData = ();
+
+            fn wait<C: super::TaskContext<Self>>(&mut self, _: &mut [C], may_block: bool) {
+                if may_block {
+                    while INTERRUPTS.load(Ordering::Relaxed) == 0 {
+                        std::thread::yield_now();
+                    }
+                }
+            }
+
+            fn remote_wake(&self) -> Option<&'static RemoteWake> {
+                Some(&REMOTE)
+            }
+
+            fn new_context(&self) -> Self::TaskLocalData {}
+        }
+
+        /// Parks and is woken from another thread.
+        async fn parked() -> Result<(), ()> {
+            let mut woken = false;
+            poll_fn(|cx| {
+                if woken {
+                    return Poll::Ready(Ok(()));
+                }
+                woken = true;
+                let waker = cx.waker().clone();
+                std::thread::spawn(move || {
+                    // Give the executor time to block
+                    std::thread::sleep(std::time::Duration::from_millis(20));
+                    waker.wake()
+                });
+                Poll::Pending
+            })
+            .await
+        }
+
+        let mut executor: Executor<'_, BlockingExecutor, Result<(), ()>, 1> = Executor::new(BlockingExecutor);
+        executor.add(Box::leak(Box::new(TaskStorage::new(parked()))));
+        executor.run();
+
+        assert_eq!(INTERRUPTS.load(Ordering::Relaxed), 1);
+    }
+
+    /// Wakes one task per [RawExecutor::wait] call in round robin order and
+    /// lets all tasks complete once the given number of wakeups was delivered.
+    struct RoundRobinExecutor {
+        next: usize,
+        wakeups: usize,
+    }
+
+    crate::task_local_data!((usize, bool));
+
+    impl RawExecutor for RoundRobinExecutor {
+        /// Number of polls and whether the task shall complete.
+        type TaskLocalData = (usize, bool);
+
+        fn wait<C: super::TaskContext<Self>>(&mut self, tasks: &mut [C], _may_block: bool) {
+            if self.wakeups == 0 {
+                for task in tasks.iter_mut() {
+                    task.local_data().1 = true;
+                    task.mark_ready();
+                }
+                return;
+            }
+
+            self.wakeups -= 1;
+            tasks[self.next % tasks.len()].mark_ready();
+            self.next += 1;
+        }
+
+        fn new_context(&self) -> Self::TaskLocalData {
+            (0, false)
+        }
+    }
+
+    type RoundRobinResult = Result<usize, ()>;
+
+    /// Counts its polls and returns them once told to complete.
+    async fn sleeper() -> RoundRobinResult {
+        poll_fn(|cx| {
+            Executor::<RoundRobinExecutor, RoundRobinResult, 0>::with_local_data(
+                |(polls, done)| {
+                    *polls += 1;
+                    if *done {
+                        Poll::Ready(Ok(*polls))
+                    } else {
+                        Poll::Pending
+                    }
+                },
+                cx,
+            )
+        })
+        .await
+    }
+
+    /// Run `N` [sleeper] tasks in a [RoundRobinExecutor].
+    fn run_round_robin<const N: usize>(wakeups: usize) -> [Option<RoundRobinResult>; N] {
+        let storages: Vec<_> = (0..N).map(|_| TaskStorage::new(sleeper())).collect();
+        let storages = Box::into_raw(storages.into_boxed_slice());
+
+        let mut executor: Executor<'_, _, _, N> = Executor::new(RoundRobinExecutor { next: 0, wakeups });
+        // SAFETY: The storages are only reclaimed once the executor is gone.
+        for storage in unsafe { &mut *storages }.iter_mut() {
+            executor.add(storage);
+        }
+        let results = executor.run();
+
+        // SAFETY: The executor was consumed by `run`, nothing refers to the storages anymore.
+        drop(unsafe { Box::from_raw(storages) });
+
+        results
+    }
+
+    #[test]
+    fn only_woken_tasks_are_polled() {
+        // More than one ready block, every task is woken twice.
+        const TASKS: usize = 40;
+
+        let results = run_round_robin::<TASKS>(2 * TASKS);
+
+        // Initial poll, two wakeups and the final poll.
+        assert!(results.iter().all(|result| *result == Some(Ok(4))));
+    }
+
+    /// Number of wakeups delivered per benchmark iteration.
+    ///
+    /// The cost of a single wakeup is the reported time divided by this; it
+    /// shall not depend on the number of tasks.
+    const BENCH_WAKEUPS: usize = 4096;
+
+    fn bench_wakeups<const N: usize>(bencher: &mut test::Bencher) {
+        bencher.iter(|| run_round_robin::<N>(BENCH_WAKEUPS));
+    }
+
+    #[bench]
+    fn wakeup_4_tasks(bencher: &mut test::Bencher) {
+        bench_wakeups::<4>(bencher)
+    }
+
+    #[bench]
+    fn wakeup_16_tasks(bencher: &mut test::Bencher) {
+        bench_wakeups::<16>(bencher)
+    }
+
+    #[bench]
+    fn wakeup_64_tasks(bencher: &mut test::Bencher) {
+        bench_wakeups::<64>(bencher)
+    }
 }
@@ -2,14 +2,25 @@
 //!
 //! This module defines the core utilities to provide an asynchronous runtime.
 //!
-//! The [generic executor](executor::Executor) is the core of the asynchronous runtime.
+//! The [generic executor](executor::Executor) is the core of the asynchronous runtime;
+//! the [static executor](static_executor::StaticExecutor) is its statically
+//! dispatched counterpart for tasks known at compile time. Both can run
+//! futures spawned at runtime into a [task pool](pool::TaskPool). Tasks keep
+//! each other from starving through [cooperative scheduling](budget), and
+//! may be woken from outside of their executor through [remote::RemoteWake].
 //! The hardware/OS must provide an implementation of [RawExecutor].
 #![allow(clippy::module_inception)]
 
+pub mod budget;
 pub mod executor;
+pub mod pool;
+pub mod remote;
+pub mod static_executor;
 pub mod task;
 mod waker;
 
+use remote::RemoteWake;
+
 /// Defines when tasks are ready and provides an implementation to wait for a
 /// task to become ready.
 ///
@@ -21,8 +32,9 @@ pub trait RawExecutor: Sized {
     /// The data available locally to a task.
     ///
     /// This data is provided via contexts; this is where the executor shall store
-    /// any specific implementation details
-    type TaskLocalData: 'static;
+    /// any specific implementation details. See [task::LocalData] for how it
+    /// is declared.
+    type TaskLocalData: task::LocalData;
 
     /// Checks whether any task is ready.
     ///
@@ -32,6 +44,31 @@ pub trait RawExecutor: Sized {
     /// executed via [TaskContext::mark_ready].
     fn wait<C: TaskContext<Self>>(&mut self, tasks: &mut [C], may_block: bool);
 
+    /// Notifies that a task has been polled.
+    ///
+    /// Tasks register what they are waiting for while being polled; this hook
+    /// allows the implementation to keep track of it without visiting every task
+    /// in [RawExecutor::wait]. The index is the position of the task in the slice
+    /// passed to [RawExecutor::wait].
+    fn polled<C: TaskContext<Self>>(&mut self, _index: usize, _task: &mut C) {}
+
+    /// Notifies that a task ran out of its [poll budget](budget) while being
+    /// polled.
+    ///
+    /// `exhaustions` counts how often this happened to the task so far; a task
+    /// exhausting its budget over and over keeps others waiting. The index is the
+    /// same as for [RawExecutor::polled], which is called right after this.
+    fn budget_exhausted<C: TaskContext<Self>>(&mut self, _index: usize, _exhaustions: u32, _task: &mut C) {}
+
+    /// Provides the means to interrupt [RawExecutor::wait] when a task is woken
+    /// from outside of the executor while it blocks.
+    ///
+    /// Without one, such wakeups are only noticed once the wait returns for
+    /// another reason.
+    fn remote_wake(&self) -> Option<&'static RemoteWake> {
+        None
+    }
+
     /// Generate a new context to associate with a new task.
     fn new_context(&self) -> Self::TaskLocalData;
 }
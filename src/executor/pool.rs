@@ -0,0 +1,411 @@
+//! Pools of recyclable task slots.
+//!
+//! This module allows spawning futures while an executor is running. A
+//! [TaskPool] is a fixed number of slots for futures of one type; it is added
+//! to an executor once, like a task, and a [Spawner] places futures into its
+//! free slots afterwards. Once a spawned future completes, its slot is free
+//! again.
+use core::cell::UnsafeCell;
+use core::future::Future;
+use core::mem::MaybeUninit;
+use core::pin::Pin;
+use core::sync::atomic::{AtomicU8, Ordering};
+use core::task::{Context, Poll};
+
+use super::task::{LocalData, TaskRef};
+use super::waker::storage::WakerStorage;
+use super::RawExecutor;
+
+/// The slot holds no future and can be spawned into.
+const FREE: u8 = 0;
+/// A future is being placed into the slot.
+const SPAWNING: u8 = 1;
+/// The slot holds a future that is polled by the executor.
+const RUNNING: u8 = 2;
+
+/// The pool was not added to an executor yet.
+const UNREGISTERED: u8 = 0;
+/// The pool is being added to an executor.
+const REGISTERING: u8 = 1;
+/// The pool was added to an executor, futures can be spawned.
+const REGISTERED: u8 = 2;
+
+/// A slot of a [TaskPool].
+struct PoolSlot<F, L> {
+    state: AtomicU8,
+    waker_data: UnsafeCell<WakerStorage<L>>,
+    future: UnsafeCell<MaybeUninit<F>>,
+}
+
+impl<F: Future, L: LocalData> PoolSlot<F, L> {
+    /// Allows us to create an array of slots even if they are not copy.
+    #[allow(clippy::declare_interior_mutable_const)]
+    const NEW: Self = PoolSlot {
+        state: AtomicU8::new(FREE),
+        waker_data: UnsafeCell::new(WakerStorage::new()),
+        future: UnsafeCell::new(MaybeUninit::uninit()),
+    };
+
+    /// Place a future into this slot if it is free.
+    fn spawn(&self, future: F) -> Result<(), F> {
+        if self
+            .state
+            .compare_exchange(FREE, SPAWNING, Ordering::Acquire, Ordering::Relaxed)
+            .is_err()
+        {
+            return Err(future);
+        }
+
+        // SAFETY: The state guarantees exclusive access to the future until it is
+        // set to running.
+        unsafe { (*self.future.get()).write(future) };
+        self.state.store(RUNNING, Ordering::Release);
+
+        // SAFETY: The waker data is only mutably accessed while the pool is being
+        // registered, which happens before anything is spawned.
+        unsafe { &*self.waker_data.get() }.waker_context().mark_ready();
+
+        Ok(())
+    }
+
+    /// Poll the future of this slot, if any, and free the slot once it completes.
+    ///
+    /// # Safety
+    /// The slot must be registered, which implies a `'static` lifetime, and this
+    /// must only be called by the executor it is registered with.
+    unsafe fn poll(&self) -> Poll<F::Output> {
+        if self.state.load(Ordering::Acquire) != RUNNING {
+            return Poll::Pending;
+        }
+
+        // SAFETY: Running futures are only accessed by the executor, and never
+        // moved until they are dropped.
+        let future = unsafe { Pin::new_unchecked((*self.future.get()).assume_init_mut()) };
+        // SAFETY: Registered slots have a static lifetime.
+        let waker = unsafe { (*self.waker_data.get()).waker() };
+
+        let result = future.poll(&mut Context::from_waker(&waker));
+        if result.is_ready() {
+            // SAFETY: The future is running and not accessed anymore.
+            unsafe { (*self.future.get()).assume_init_drop() };
+            self.state.store(FREE, Ordering::Release);
+        }
+
+        result
+    }
+}
+
+impl<F, L> Drop for PoolSlot<F, L> {
+    fn drop(&mut self) {
+        if *self.state.get_mut() == RUNNING {
+            // SAFETY: The future is running and never accessed again.
+            unsafe { self.future.get_mut().assume_init_drop() }
+        }
+    }
+}
+
+/// A fixed number of slots for futures of the same type.
+///
+/// The pool must be added to an executor with
+/// [Executor::add_pool](super::executor::Executor::add_pool) or
+/// [StaticExecutor::with_pool](super::static_executor::StaticExecutor::with_pool),
+/// which takes one task slot of the executor per pool slot. Futures are then
+/// spawned through a [Spawner], also from within the tasks of the executor.
+///
+/// Spawned futures behave like any other task of the executor, with two
+/// exceptions: their results are not collected, and their slot is reused once
+/// they complete. A result for which [TaskResult::bail](super::executor::TaskResult::bail)
+/// returns true still stops the executor.
+///
+/// ## Usage
+///
+/// ```ignore
+/// type Handler = impl Future<Output = PxResult<()>>;
+/// static HANDLERS: TaskPool<Handler, PxrosExecutor<AsyncEvent>, 4> = TaskPool::new();
+///
+/// fn handler(request: RawMessage) -> Handler {
+///     async move { todo!() }
+/// }
+///
+/// async fn server(spawner: Spawner<Handler>) -> PxResult<()> {
+///     loop {
+///         let request = receive_request().await?;
+///         spawner.spawn(handler(request)).map_err(|_| PxError_t::PXERR_GLOBAL_OBJLIST_EMPTY)?;
+///     }
+/// }
+/// ```
+pub struct TaskPool<F: Future, E: RawExecutor, const SIZE: usize> {
+    state: AtomicU8,
+    slots: [PoolSlot<F, E::TaskLocalData>; SIZE],
+}
+
+// SAFETY: Spawning moves a future into a slot, hence futures must be `Send`.
+// Everything else is only accessed by the executor the pool is registered with,
+// except for the generic contexts which are `Sync`.
+unsafe impl<F: Future + Send, E: RawExecutor, const SIZE: usize> Sync for TaskPool<F, E, SIZE> {}
+
+impl<F: Future, E: RawExecutor, const SIZE: usize> TaskPool<F, E, SIZE> {
+    /// Create a new pool; all slots are free.
+    pub const fn new() -> Self {
+        TaskPool {
+            state: AtomicU8::new(UNREGISTERED),
+            slots: [PoolSlot::NEW; SIZE],
+        }
+    }
+
+    /// Handle to spawn futures into this pool.
+    pub fn spawner(&'static self) -> Spawner<F>
+    where
+        F: Send + 'static,
+    {
+        Spawner { pool: self }
+    }
+
+    /// Register this pool with an executor and return the contexts of its slots.
+    ///
+    /// # Panics
+    /// This function panics if the pool was already registered.
+    pub(crate) fn register(&'static self, executor: &E) -> impl Iterator<Item = TaskRef<E>> {
+        assert!(
+            self.state
+                .compare_exchange(UNREGISTERED, REGISTERING, Ordering::Acquire, Ordering::Relaxed)
+                .is_ok(),
+            "A task pool can only be added to one executor"
+        );
+
+        for slot in self.slots.iter() {
+            // SAFETY: Nothing else accesses the waker data while registering, as
+            // spawning is only possible once registered.
+            unsafe { (*slot.waker_data.get()).init(executor.new_context()) };
+        }
+        self.state.store(REGISTERED, Ordering::Release);
+
+        self.slots.iter().map(|slot| {
+            // SAFETY: The waker data is not mutably accessed anymore.
+            TaskRef::new(unsafe { &*slot.waker_data.get() })
+        })
+    }
+
+    /// Poll the future in the given slot, if any.
+    ///
+    /// # Safety
+    /// This must only be called by the executor this pool is registered with.
+    pub(crate) unsafe fn poll(&self, slot: usize) -> Poll<F::Output> {
+        // SAFETY: See function documentation.
+        unsafe { self.slots[slot].poll() }
+    }
+
+    /// Check whether the given slot holds a future.
+    pub(crate) fn is_running(&self, slot: usize) -> bool {
+        self.slots[slot].state.load(Ordering::Acquire) != FREE
+    }
+
+    /// Check whether no slot holds a future.
+    pub(crate) fn is_idle(&self) -> bool {
+        (0..SIZE).all(|slot| !self.is_running(slot))
+    }
+}
+
+/// Type erased access to the slots of a [TaskPool] for the executor.
+pub(crate) trait Pool<R> {
+    /// See [TaskPool::poll].
+    ///
+    /// # Safety
+    /// This must only be called by the executor the pool is registered with.
+    unsafe fn poll(&self, slot: usize) -> Poll<R>;
+
+    /// See [TaskPool::is_running].
+    fn is_running(&self, slot: usize) -> bool;
+}
+
+impl<F: Future<Output = R>, E: RawExecutor, R, const SIZE: usize> Pool<R> for TaskPool<F, E, SIZE> {
+    unsafe fn poll(&self, slot: usize) -> Poll<R> {
+        // SAFETY: See function documentation.
+        unsafe { TaskPool::poll(self, slot) }
+    }
+
+    fn is_running(&self, slot: usize) -> bool {
+        TaskPool::is_running(self, slot)
+    }
+}
+
+impl<F: Future, E: RawExecutor, const SIZE: usize> Default for TaskPool<F, E, SIZE> {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+/// Type erased access to a [TaskPool], see [Spawner].
+trait Spawn<F> {
+    fn spawn(&self, future: F) -> Result<(), F>;
+}
+
+impl<F: Future, E: RawExecutor, const SIZE: usize> Spawn<F> for TaskPool<F, E, SIZE> {
+    fn spawn(&self, future: F) -> Result<(), F> {
+        if self.state.load(Ordering::Acquire) != REGISTERED {
+            return Err(future);
+        }
+
+        let mut future = future;
+        for slot in self.slots.iter() {
+            match slot.spawn(future) {
+                Ok(()) => return Ok(()),
+                Err(returned) => future = returned,
+            }
+        }
+
+        Err(future)
+    }
+}
+
+/// Handle to spawn futures into a [TaskPool].
+///
+/// The handle can be copied freely, e.g. into the tasks that spawn futures.
+pub struct Spawner<F: 'static> {
+    pool: &'static (dyn Spawn<F> + Sync),
+}
+
+impl<F: 'static> Spawner<F> {
+    /// Spawn a future into a free slot of the pool.
+    ///
+    /// The future is polled by the executor the pool was added to, starting
+    /// with its next iteration. If all slots are taken, or the pool was not
+    /// added to an executor yet, the future is handed back.
+    pub fn spawn(&self, future: F) -> Result<(), F> {
+        self.pool.spawn(future)
+    }
+}
+
+impl<F: 'static> Clone for Spawner<F> {
+    fn clone(&self) -> Self {
+        *self
+    }
+}
+
+impl<F: 'static> Copy for Spawner<F> {}
+
+#[cfg(test)]
+mod tests {
+    use core::future::{poll_fn, Future};
+    use core::pin::Pin;
+    use core::sync::atomic::{AtomicU32, Ordering};
+    use core::task::{Context, Poll};
+
+    use super::{Spawner, TaskPool};
+    use crate::executor::executor::Executor;
+    use crate::executor::static_executor::StaticExecutor;
+    use crate::executor::task::TaskStorage;
+    use crate::executor::RawExecutor;
+
+    struct SimpleExecutor;
+
+    impl RawExecutor for SimpleExecutor {
+        type TaskLocalData = ();
+
+        fn wait<C: crate::executor::TaskContext<Self>>(&mut self, _: &mut [C], _may_block: bool) {}
+
+        fn new_context(&self) -> Self::TaskLocalData {}
+    }
+
+    /// Yields a few times, then records its completion.
+    struct Job {
+        id: u32,
+        yields: u8,
+        completed: &'static AtomicU32,
+    }
+
+    impl Future for Job {
+        type Output = Result<(), ()>;
+
+        fn poll(mut self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<Self::Output> {
+            if self.yields == 0 {
+                self.completed.fetch_or(1 << self.id, Ordering::Relaxed);
+                return Poll::Ready(Ok(()));
+            }
+
+            self.yields -= 1;
+            cx.waker().wake_by_ref();
+            Poll::Pending
+        }
+    }
+
+    /// Number of jobs spawned per test, more than fit in the pool at once.
+    const JOBS: u32 = 6;
+
+    type JobPool = TaskPool<Job, SimpleExecutor, 2>;
+
+    /// Spawns [JOBS] jobs, waiting for a free slot whenever the pool is full.
+    async fn server(spawner: Spawner<Job>, completed: &'static AtomicU32) -> Result<(), ()> {
+        for id in 0..JOBS {
+            let mut job = Some(Job {
+                id,
+                yields: 3,
+                completed,
+            });
+
+            poll_fn(|cx| match spawner.spawn(job.take().unwrap()) {
+                Ok(()) => Poll::Ready(()),
+                Err(returned) => {
+                    job = Some(returned);
+                    cx.waker().wake_by_ref();
+                    Poll::Pending
+                },
+            })
+            .await;
+        }
+
+        Ok(())
+    }
+
+    #[test]
+    fn spawn_before_registration() {
+        let pool: &'static JobPool = Box::leak(Box::new(TaskPool::new()));
+        let completed = Box::leak(Box::new(AtomicU32::new(0)));
+
+        let job = Job {
+            id: 0,
+            yields: 0,
+            completed,
+        };
+        assert!(pool.spawner().spawn(job).is_err());
+    }
+
+    #[test]
+    fn slots_are_recycled() {
+        let pool: &'static JobPool = Box::leak(Box::new(TaskPool::new()));
+        let completed: &'static AtomicU32 = Box::leak(Box::new(AtomicU32::new(0)));
+        let task = Box::leak(Box::new(TaskStorage::new(server(pool.spawner(), completed))));
+
+        let mut executor: Executor<'_, _, _, 3> = Executor::new(SimpleExecutor);
+        executor.add(task);
+        executor.add_pool(pool);
+        let results = executor.run();
+
+        assert_eq!(results, [Some(Ok(())), None, None]);
+        assert_eq!(completed.load(Ordering::Relaxed), (1 << JOBS) - 1);
+        assert!(pool.is_idle());
+    }
+
+    #[test]
+    fn static_executor_slots_are_recycled() {
+        let pool: &'static JobPool = Box::leak(Box::new(TaskPool::new()));
+        let completed: &'static AtomicU32 = Box::leak(Box::new(AtomicU32::new(0)));
+        let task = Box::leak(Box::new(TaskStorage::new(server(pool.spawner(), completed))));
+
+        let executor: StaticExecutor<_, _, _, 3> = StaticExecutor::new(SimpleExecutor);
+        let results = executor.with_pool(pool).with_task(task).run();
+
+        assert_eq!(results, [None, None, Some(Ok(()))]);
+        assert_eq!(completed.load(Ordering::Relaxed), (1 << JOBS) - 1);
+    }
+
+    #[test]
+    #[should_panic(expected = "A task pool can only be added to one executor")]
+    fn register_twice() {
+        let pool: &'static JobPool = Box::leak(Box::new(TaskPool::new()));
+
+        let mut executor: Executor<'_, _, Result<(), ()>, 4> = Executor::new(SimpleExecutor);
+        executor.add_pool(pool);
+        executor.add_pool(pool);
+    }
+}
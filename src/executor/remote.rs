@@ -0,0 +1,69 @@
+//! Wakeups from outside of an executor.
+//!
+//! Waking a task only marks it ready; the executor notices this the next time it
+//! checks. If the waker is invoked from outside of the executor, e.g. from
+//! another OS task, another core or an interrupt handler, while the executor is
+//! blocked waiting on the OS, the task would only be polled once something
+//! unrelated unblocks the executor. A [RemoteWake] registered by the [RawExecutor](super::RawExecutor)
+//! closes this gap: it is armed right before the executor blocks, and the first
+//! wakeup hitting an armed [RemoteWake] interrupts the wait.
+use core::sync::atomic::{fence, AtomicBool, AtomicU32, Ordering};
+
+/// Interrupts the blocking wait of an executor when one of its tasks is woken.
+///
+/// This must have a `'static` lifetime as wakers keep referring to it; see
+/// [RawExecutor::remote_wake](super::RawExecutor::remote_wake).
+pub struct RemoteWake {
+    /// Whether the executor is about to block or blocked.
+    armed: AtomicBool,
+    /// Executor specific identification of the executor, e.g. its OS task.
+    owner: AtomicU32,
+    /// Interrupts the blocking wait of the given owner.
+    interrupt: fn(u32),
+}
+
+impl RemoteWake {
+    /// Create a new instance using the given function to interrupt the wait of
+    /// the executor, which receives the owner set via [RemoteWake::set_owner].
+    pub const fn new(interrupt: fn(u32)) -> Self {
+        RemoteWake {
+            armed: AtomicBool::new(false),
+            owner: AtomicU32::new(0),
+            interrupt,
+        }
+    }
+
+    /// Set the identification of the executor passed to the interrupt function.
+    pub fn set_owner(&self, owner: u32) {
+        self.owner.store(owner, Ordering::Relaxed);
+    }
+
+    /// Signal that the executor checks for ready tasks one last time and then
+    /// blocks.
+    pub(crate) fn arm(&self) {
+        self.armed.store(true, Ordering::Relaxed);
+        // Pairs with the fence in `wake`: either the executor sees the ready
+        // task, or the waker sees the executor being armed.
+        fence(Ordering::SeqCst);
+    }
+
+    /// Signal that the executor is not blocked anymore.
+    ///
+    /// Wakeups are only forwarded while armed, which includes the ones issued by
+    /// the executor itself; [RawExecutor::wait](super::RawExecutor::wait) should
+    /// disarm as soon as it stops blocking to avoid interrupting itself.
+    pub fn disarm(&self) {
+        self.armed.store(false, Ordering::Relaxed);
+    }
+
+    /// Interrupt the executor if it is blocked; called after a task was marked
+    /// ready.
+    ///
+    /// Only the first wakeup after arming interrupts the executor.
+    pub(crate) fn wake(&self) {
+        fence(Ordering::SeqCst);
+        if self.armed.load(Ordering::Relaxed) && self.armed.swap(false, Ordering::AcqRel) {
+            (self.interrupt)(self.owner.load(Ordering::Relaxed))
+        }
+    }
+}
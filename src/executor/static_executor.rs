@@ -0,0 +1,497 @@
+//! Statically dispatched executor.
+//!
+//! This module defines an executor for a set of tasks that is known at compile
+//! time. Instead of storing the tasks as trait objects, the tasks are kept in a
+//! list whose type records the type of every task. `pxros_run!` polls them
+//! through a `match` on the task index, which compiles down to a jump table
+//! into the poll functions of the tasks, which the compiler is free to inline.
+use core::future::Future;
+use core::pin::Pin;
+use core::ptr::NonNull;
+use core::task::{Context, Poll};
+
+use heapless::Vec;
+
+use super::executor::{add_context, run_tasks, ExecutorContext, Priority, TaskResult, TaskSet};
+use super::pool::TaskPool;
+use super::task::{Task, TaskStorage};
+use super::RawExecutor;
+
+/// A list of tasks whose types are known at compile time.
+///
+/// The list is built by [StaticExecutor::with_task] and [StaticExecutor::with_pool];
+/// the task added last is the head of the list.
+pub trait TaskList<E: RawExecutor, R> {
+    /// Number of tasks in the list; every slot of a pool counts as a task.
+    const LEN: usize;
+
+    /// Poll the task at the given index, in the order the tasks were added.
+    ///
+    /// This walks the list until it reaches the task; prefer
+    /// [TaskList::poll_task] where the index is known at compile time.
+    fn poll(&mut self, index: usize) -> Poll<R>;
+
+    /// Poll the task at the given index, in the order the tasks were added.
+    ///
+    /// The task is selected at compile time, so this is a direct call to its
+    /// poll function.
+    fn poll_task<const INDEX: usize>(&mut self) -> Poll<R>;
+
+    /// Check whether the task at the given index is a slot of a [TaskPool].
+    fn is_pooled(&self, index: usize) -> bool;
+
+    /// Check whether none of the pools in the list holds a future.
+    fn pools_idle(&self) -> bool;
+}
+
+/// Adapter running a [TaskList] in [run_tasks], polling its tasks through a
+/// dispatch function.
+struct ListTasks<'a, T, D> {
+    tasks: &'a mut T,
+    dispatch: D,
+}
+
+impl<E, R, T, D> TaskSet<E, R> for ListTasks<'_, T, D>
+where
+    E: RawExecutor,
+    T: TaskList<E, R>,
+    D: FnMut(&mut T, usize) -> Poll<R>,
+{
+    fn poll(&mut self, index: usize) -> Poll<R> {
+        (self.dispatch)(self.tasks, index)
+    }
+
+    fn is_pooled(&self, index: usize) -> bool {
+        self.tasks.is_pooled(index)
+    }
+
+    fn pools_idle(&self) -> bool {
+        self.tasks.pools_idle()
+    }
+}
+
+/// The empty [TaskList].
+pub struct TaskNil;
+
+impl<E: RawExecutor, R> TaskList<E, R> for TaskNil {
+    const LEN: usize = 0;
+
+    fn poll(&mut self, index: usize) -> Poll<R> {
+        panic!("No task at index {}", index)
+    }
+
+    fn poll_task<const INDEX: usize>(&mut self) -> Poll<R> {
+        panic!("No task at index {}", INDEX)
+    }
+
+    fn is_pooled(&self, _index: usize) -> bool {
+        false
+    }
+
+    fn pools_idle(&self) -> bool {
+        true
+    }
+}
+
+/// A [TaskList] made of a task and the list of the tasks added before it.
+pub struct TaskCons<F: Future + 'static, E: RawExecutor + 'static, T> {
+    /// The pinned `'static` storage of the task.
+    ///
+    /// This is a pointer rather than a `&'static mut`: the [TaskRef](super::task::TaskRef)
+    /// of the task is derived from the same pointer, so polling the task does
+    /// not invalidate it.
+    head: NonNull<TaskStorage<F, E>>,
+    tail: T,
+}
+
+impl<F, E, R, T> TaskList<E, R> for TaskCons<F, E, T>
+where
+    F: Future<Output = R> + 'static,
+    E: RawExecutor + 'static,
+    T: TaskList<E, R>,
+{
+    const LEN: usize = T::LEN + 1;
+
+    #[inline(always)]
+    fn poll(&mut self, index: usize) -> Poll<R> {
+        if index == T::LEN {
+            self.poll_head()
+        } else {
+            self.tail.poll(index)
+        }
+    }
+
+    #[inline(always)]
+    fn poll_task<const INDEX: usize>(&mut self) -> Poll<R> {
+        // Resolved at compile time
+        if INDEX == T::LEN {
+            self.poll_head()
+        } else {
+            self.tail.poll_task::<INDEX>()
+        }
+    }
+
+    fn is_pooled(&self, index: usize) -> bool {
+        index != T::LEN && self.tail.is_pooled(index)
+    }
+
+    fn pools_idle(&self) -> bool {
+        self.tail.pools_idle()
+    }
+}
+
+impl<F: Future + 'static, E: RawExecutor + 'static, T> TaskCons<F, E, T> {
+    #[inline(always)]
+    fn poll_head(&mut self) -> Poll<F::Output> {
+        // SAFETY: The storage is `'static` and never moved, see
+        // `StaticExecutor::with_task_priority`; the executor does not access its
+        // local data while the task is polled.
+        unsafe { Pin::new_unchecked(self.head.as_mut()) }.poll()
+    }
+}
+
+/// A [TaskList] made of the slots of a [TaskPool] and the list of the tasks
+/// added before it.
+pub struct PoolCons<F: Future + 'static, E: RawExecutor + 'static, T, const SIZE: usize> {
+    head: &'static TaskPool<F, E, SIZE>,
+    tail: T,
+}
+
+impl<F, E, R, T, const SIZE: usize> TaskList<E, R> for PoolCons<F, E, T, SIZE>
+where
+    F: Future<Output = R> + 'static,
+    E: RawExecutor + 'static,
+    T: TaskList<E, R>,
+{
+    const LEN: usize = T::LEN + SIZE;
+
+    #[inline(always)]
+    fn poll(&mut self, index: usize) -> Poll<R> {
+        if index >= T::LEN {
+            // SAFETY: The pool was registered with the executor owning this list.
+            unsafe { self.head.poll(index - T::LEN) }
+        } else {
+            self.tail.poll(index)
+        }
+    }
+
+    #[inline(always)]
+    fn poll_task<const INDEX: usize>(&mut self) -> Poll<R> {
+        // Resolved at compile time
+        if INDEX >= T::LEN {
+            // SAFETY: The pool was registered with the executor owning this list.
+            unsafe { self.head.poll(INDEX - T::LEN) }
+        } else {
+            self.tail.poll_task::<INDEX>()
+        }
+    }
+
+    fn is_pooled(&self, index: usize) -> bool {
+        index >= T::LEN || self.tail.is_pooled(index)
+    }
+
+    fn pools_idle(&self) -> bool {
+        self.head.is_idle() && self.tail.pools_idle()
+    }
+}
+
+/// An executor for a fixed set of tasks known at compile time.
+///
+/// This behaves like [Executor](super::executor::Executor), but does not use
+/// trait objects: adding a task changes the type of the executor, and polling
+/// a task is statically dispatched. The executor facing data of the tasks (see
+/// [RawExecutor::TaskLocalData]) is accessed directly.
+///
+/// ## Usage
+///
+/// Since every [StaticExecutor::with_task] returns a new executor, tasks are added
+/// by shadowing:
+///
+/// ```ignore
+/// let executor: StaticExecutor<_, Result<(), ()>, _, 2> = StaticExecutor::new(raw_executor);
+/// let executor = executor.with_task(task_a);
+/// let executor = executor.with_task(task_b);
+/// let results = executor.run();
+/// ```
+pub struct StaticExecutor<E: RawExecutor, R, T, const TASK_COUNT: usize> {
+    tasks: T,
+    contexts: Vec<ExecutorContext<E>, TASK_COUNT>,
+    executor: E,
+    _result: core::marker::PhantomData<fn() -> R>,
+}
+
+impl<E: RawExecutor, R, const TASK_COUNT: usize> StaticExecutor<E, R, TaskNil, TASK_COUNT>
+where
+    R: 'static,
+    R: TaskResult,
+{
+    /// Creates a new instance without any task.
+    pub fn new(executor: E) -> Self {
+        StaticExecutor {
+            tasks: TaskNil,
+            contexts: Vec::new(),
+            executor,
+            _result: core::marker::PhantomData,
+        }
+    }
+}
+
+impl<E: RawExecutor + 'static, R, T, const TASK_COUNT: usize> StaticExecutor<E, R, T, TASK_COUNT>
+where
+    R: 'static,
+    R: TaskResult,
+    T: TaskList<E, R>,
+{
+    /// Add a task to be run in this executor with [Priority::Normal].
+    ///
+    /// # Panics
+    /// This function panics if the executor is full.
+    pub fn with_task<F>(
+        self,
+        task: &'static mut TaskStorage<F, E>,
+    ) -> StaticExecutor<E, R, TaskCons<F, E, T>, TASK_COUNT>
+    where
+        F: Future<Output = R> + 'static,
+    {
+        self.with_task_priority(task, Priority::Normal)
+    }
+
+    /// Add a task to be run in this executor with the given priority.
+    ///
+    /// # Panics
+    /// This function panics if the executor is full.
+    pub fn with_task_priority<F>(
+        mut self,
+        task: &'static mut TaskStorage<F, E>,
+        priority: Priority,
+    ) -> StaticExecutor<E, R, TaskCons<F, E, T>, TASK_COUNT>
+    where
+        F: Future<Output = R> + 'static,
+    {
+        let local_context = self.executor.new_context();
+        // The storage is `'static` and only accessed through this pointer from
+        // now on, so it is never moved
+        let task = NonNull::from(task.init(local_context));
+
+        // SAFETY: See above; the storage is initialized.
+        add_context(&mut self.contexts, unsafe { TaskStorage::raw_task_ref(task) }, priority);
+
+        StaticExecutor {
+            tasks: TaskCons {
+                head: task,
+                tail: self.tasks,
+            },
+            contexts: self.contexts,
+            executor: self.executor,
+            _result: core::marker::PhantomData,
+        }
+    }
+
+    /// Add the slots of a task pool to this executor; futures spawned into the
+    /// pool are run by this executor.
+    ///
+    /// Every slot takes the place of a task with [Priority::Normal]: the executor
+    /// must have space for all of them, and their entry in the results of
+    /// [StaticExecutor::run] is always empty.
+    ///
+    /// # Panics
+    /// This function panics if the executor is full, or if the pool was already
+    /// added to an executor.
+    pub fn with_pool<F, const POOL_SIZE: usize>(
+        mut self,
+        pool: &'static TaskPool<F, E, POOL_SIZE>,
+    ) -> StaticExecutor<E, R, PoolCons<F, E, T, POOL_SIZE>, TASK_COUNT>
+    where
+        F: Future<Output = R> + 'static,
+    {
+        for context in pool.register(&self.executor) {
+            add_context(&mut self.contexts, context, Priority::Normal);
+        }
+
+        StaticExecutor {
+            tasks: PoolCons {
+                head: pool,
+                tail: self.tasks,
+            },
+            contexts: self.contexts,
+            executor: self.executor,
+            _result: core::marker::PhantomData,
+        }
+    }
+
+    /// Run until either all tasks in the executor have finished or return early
+    /// if one of the tasks finishes with a result where [TaskResult::bail]
+    /// returns true.
+    ///
+    /// Tasks are found by walking the list, see [TaskList::poll];
+    /// [StaticExecutor::run_with] avoids this.
+    ///
+    /// This method relies on the implementation of [RawExecutor::wait].
+    pub fn run(self) -> [Option<R>; TASK_COUNT] {
+        self.run_with(|tasks, index| tasks.poll(index))
+    }
+
+    /// Run like [StaticExecutor::run], polling the task at an index through
+    /// `dispatch`.
+    ///
+    /// This is meant for a `match` on the index with an arm per task calling
+    /// [TaskList::poll_task], as generated by `pxros_run!`, so polling a task
+    /// costs a jump table lookup rather than a comparison per task:
+    ///
+    /// ```ignore
+    /// executor.run_with(|tasks, index| match index {
+    ///     0 => tasks.poll_task::<0>(),
+    ///     1 => tasks.poll_task::<1>(),
+    ///     // Slots of pools
+    ///     index => tasks.poll(index),
+    /// })
+    /// ```
+    pub fn run_with<D>(mut self, dispatch: D) -> [Option<R>; TASK_COUNT]
+    where
+        D: FnMut(&mut T, usize) -> Poll<R>,
+    {
+        let mut tasks = ListTasks {
+            tasks: &mut self.tasks,
+            dispatch,
+        };
+        run_tasks(&mut self.executor, &mut self.contexts, &mut tasks)
+    }
+
+    /// Allows access to the current task local data.
+    ///
+    /// # Panics
+    /// This function will panic if not called from within this executor.
+    pub fn with_local_data<F, U>(callback: F, cx: &Context<'_>) -> Poll<U>
+    where
+        F: FnMut(&mut E::TaskLocalData) -> Poll<U>,
+    {
+        super::waker::with_local_data(callback, cx)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    extern crate test;
+
+    use core::future::poll_fn;
+    use core::task::Poll;
+
+    use super::{StaticExecutor, TaskList};
+    use crate::executor::executor::Executor;
+    use crate::executor::task::{with_local_data, TaskStorage};
+    use crate::executor::RawExecutor;
+
+    struct SimpleExecutor;
+
+    crate::task_local_data!(u32);
+
+    impl RawExecutor for SimpleExecutor {
+        type TaskLocalData = u32;
+
+        fn wait<C: super::super::TaskContext<Self>>(&mut self, _: &mut [C], _may_block: bool) {}
+
+        fn new_context(&self) -> Self::TaskLocalData {
+            0
+        }
+    }
+
+    type YieldResult = Result<u32, ()>;
+
+    /// Yields the given number of times, counting its polls in the local data.
+    async fn yielder(count: u32) -> YieldResult {
+        poll_fn(|cx| {
+            with_local_data(
+                |polls: &mut u32| {
+                    *polls += 1;
+                    if *polls > count {
+                        Poll::Ready(Ok(*polls))
+                    } else {
+                        cx.waker().wake_by_ref();
+                        Poll::Pending
+                    }
+                },
+                cx,
+            )
+        })
+        .await
+    }
+
+    /// Number of [yielder] tasks per test.
+    const TASKS: usize = 8;
+
+    /// Run [TASKS] [yielder] tasks in a [StaticExecutor].
+    fn run_static(count: u32) -> [Option<YieldResult>; TASKS] {
+        let storages: Vec<_> = (0..TASKS).map(|_| TaskStorage::new(yielder(count))).collect();
+        let storages = Box::into_raw(storages.into_boxed_slice());
+
+        // SAFETY: The storages are only reclaimed once the executor is gone.
+        let [a, b, c, d, e, f, g, h] = (unsafe { &mut *storages }) else {
+            unreachable!()
+        };
+        let executor: StaticExecutor<_, _, _, TASKS> = StaticExecutor::new(SimpleExecutor);
+        let results = executor
+            .with_task(a)
+            .with_task(b)
+            .with_task(c)
+            .with_task(d)
+            .with_task(e)
+            .with_task(f)
+            .with_task(g)
+            .with_task(h)
+            .run_with(|tasks, index| match index {
+                0 => tasks.poll_task::<0>(),
+                1 => tasks.poll_task::<1>(),
+                2 => tasks.poll_task::<2>(),
+                3 => tasks.poll_task::<3>(),
+                4 => tasks.poll_task::<4>(),
+                5 => tasks.poll_task::<5>(),
+                6 => tasks.poll_task::<6>(),
+                7 => tasks.poll_task::<7>(),
+                index => tasks.poll(index),
+            });
+
+        // SAFETY: The executor was consumed by `run`, nothing refers to the storages anymore.
+        drop(unsafe { Box::from_raw(storages) });
+
+        results
+    }
+
+    /// Run [TASKS] [yielder] tasks in an [Executor].
+    fn run_dynamic(count: u32) -> [Option<YieldResult>; TASKS] {
+        let storages: Vec<_> = (0..TASKS).map(|_| TaskStorage::new(yielder(count))).collect();
+        let storages = Box::into_raw(storages.into_boxed_slice());
+
+        let mut executor: Executor<'_, _, _, TASKS> = Executor::new(SimpleExecutor);
+        // SAFETY: The storages are only reclaimed once the executor is gone.
+        for storage in unsafe { &mut *storages }.iter_mut() {
+            executor.add(storage);
+        }
+        let results = executor.run();
+
+        // SAFETY: The executor was consumed by `run`, nothing refers to the storages anymore.
+        drop(unsafe { Box::from_raw(storages) });
+
+        results
+    }
+
+    #[test]
+    fn all_tasks_complete() {
+        let results = run_static(5);
+
+        assert!(results.iter().all(|result| *result == Some(Ok(6))));
+        assert_eq!(results, run_dynamic(5));
+    }
+
+    /// Number of yields per task and benchmark iteration.
+    const BENCH_YIELDS: u32 = 512;
+
+    #[bench]
+    fn poll_static_dispatch(bencher: &mut test::Bencher) {
+        bencher.iter(|| run_static(BENCH_YIELDS));
+    }
+
+    #[bench]
+    fn poll_dynamic_dispatch(bencher: &mut test::Bencher) {
+        bencher.iter(|| run_dynamic(BENCH_YIELDS));
+    }
+}
@@ -5,12 +5,14 @@
 use core::future::Future;
 use core::pin::Pin;
 use core::ptr::NonNull;
-use core::sync::atomic::{AtomicU32, Ordering};
+use core::sync::atomic::{AtomicBool, AtomicPtr, AtomicU16, AtomicU32, AtomicU8, Ordering};
 use core::task::{Context, Poll};
 
+use super::budget::POLL_BUDGET;
+use super::remote::RemoteWake;
 use super::waker::storage::WakerStorage;
-pub use super::waker::with_local_data;
-use super::RawExecutor;
+pub use super::waker::{waker_vtable, with_local_data, LocalData};
+use super::{RawExecutor, TaskContext};
 
 /// This is the abstraction between the generic executor and the task storage.
 ///
@@ -19,36 +21,194 @@ use super::RawExecutor;
 pub(crate) trait Task<E: RawExecutor, R> {
     /// Poll the task in [Future] fashion.
     fn poll(self: Pin<&mut Self>) -> Poll<R>;
+}
 
-    /// Access the local data of the task. See [RawExecutor]
-    /// for documentation.
-    fn local_data(self: Pin<&mut Self>) -> &mut E::TaskLocalData;
+/// Executor facing handle of a task.
+///
+/// Gives direct access to the local data and the [GenericContext] of a task,
+/// independent of the type of its future, so the executor does not need to go
+/// through [Task] for anything but polling.
+pub(crate) struct TaskRef<E: RawExecutor> {
+    storage: NonNull<WakerStorage<E::TaskLocalData>>,
+}
+
+impl<E: RawExecutor> TaskRef<E> {
+    /// Create a handle to an initialized storage.
+    ///
+    /// # Panics
+    /// This will panic if the storage is not initialized.
+    pub(crate) fn new(storage: &'static WakerStorage<E::TaskLocalData>) -> Self {
+        TaskRef {
+            storage: storage.as_ptr(),
+        }
+    }
 
     /// Provide access to the global context that is also available through the Waker.
-    fn waker_context(&self) -> &GenericContext;
+    pub(crate) fn waker_context(&self) -> &GenericContext {
+        // SAFETY: The storage has a static lifetime, see `TaskStorage::task_ref`.
+        unsafe { self.storage.as_ref() }.waker_context()
+    }
 }
 
+impl<E: RawExecutor> TaskContext<E> for TaskRef<E> {
+    fn local_data(&mut self) -> &mut E::TaskLocalData {
+        // SAFETY: The storage has a static lifetime and is initialized, see
+        // `TaskStorage::task_ref`. The executor only calls this while the task
+        // is not being polled, so nobody else accesses the local data.
+        unsafe { self.storage.as_ref().local_data() }
+    }
+
+    fn mark_ready(&self) {
+        self.waker_context().mark_ready()
+    }
+}
+
+/// Number of tasks sharing one ready word.
+pub(crate) const READY_BLOCK: usize = u32::BITS as usize;
+
 /// Generic context that must be available for every task storage, independent
 /// of the specific executor.
-#[derive(Default)]
+///
+/// Readiness is tracked per block of [READY_BLOCK] tasks: the first task of a
+/// block hosts the ready word of the whole block and every task of the block
+/// owns one bit in it. This allows the executor to find the ready tasks without
+/// visiting the ones that are not.
 pub(crate) struct GenericContext {
-    is_ready: AtomicU32,
+    /// Ready word of the block hosted by this context.
+    ///
+    /// This is only used if the task is the first one of its block, or if it was
+    /// not attached to an executor yet.
+    ready_block: AtomicU32,
+    /// Ready word this task reports to, null until attached to an executor.
+    block: AtomicPtr<AtomicU32>,
+    /// Interrupts the executor when woken from outside, null if not supported.
+    remote: AtomicPtr<RemoteWake>,
+    /// Bit of this task in its ready word.
+    bit: AtomicU8,
+    /// Budget left for the current poll, see [crate::executor::budget].
+    budget: AtomicU16,
+    /// Whether the task ran out of budget during the current poll.
+    exhausted: AtomicBool,
 }
 
 impl GenericContext {
-    /// Mark this context as ready.
-    pub fn mark_ready(&self) {
-        self.is_ready.store(1, Ordering::Release);
+    /// Create a new context, not attached to any executor.
+    pub(crate) const fn new() -> Self {
+        GenericContext {
+            ready_block: AtomicU32::new(0),
+            block: AtomicPtr::new(core::ptr::null_mut()),
+            remote: AtomicPtr::new(core::ptr::null_mut()),
+            bit: AtomicU8::new(0),
+            budget: AtomicU16::new(POLL_BUDGET),
+            exhausted: AtomicBool::new(false),
+        }
     }
 
-    /// Check whether this context is marked as ready.
-    pub fn is_ready(&self) -> bool {
-        self.is_ready.load(Ordering::Acquire) == 1
+    /// Attach this context to the ready word of its block and to the remote
+    /// wake of its executor.
+    ///
+    /// # Safety
+    /// The ready word must outlive this context, which in practice means it is
+    /// hosted by a context living in a `'static` [TaskStorage].
+    pub(crate) unsafe fn attach(&self, block: NonNull<AtomicU32>, bit: usize, remote: Option<&'static RemoteWake>) {
+        let was_ready = self.clear_ready();
+
+        let remote = remote.map_or(core::ptr::null_mut(), |remote| remote as *const RemoteWake as *mut RemoteWake);
+        self.remote.store(remote, Ordering::Release);
+        self.bit.store(bit as u8, Ordering::Relaxed);
+        self.block.store(block.as_ptr(), Ordering::Release);
+
+        if was_ready {
+            self.mark_ready();
+        }
+    }
+
+    /// The ready word this context reports to.
+    fn ready_word(&self) -> &AtomicU32 {
+        let block = self.block.load(Ordering::Acquire);
+
+        // SAFETY: A non-null block pointer was set by `attach`, whose caller
+        // guarantees that it outlives this context.
+        unsafe { block.as_ref() }.unwrap_or(&self.ready_block)
+    }
+
+    /// Bit of this task in its ready word.
+    fn mask(&self) -> u32 {
+        1 << self.bit.load(Ordering::Relaxed)
+    }
+
+    /// Mark this context as ready, interrupting the executor if it is blocked.
+    pub fn mark_ready(&self) {
+        self.ready_word().fetch_or(self.mask(), Ordering::Release);
+
+        // SAFETY: A non-null remote wake was set by `attach` from a `'static`
+        // reference.
+        if let Some(remote) = unsafe { self.remote.load(Ordering::Acquire).as_ref() } {
+            remote.wake()
+        }
     }
 
     /// Clear and return the previous ready status.
     pub(crate) fn clear_ready(&self) -> bool {
-        self.is_ready.swap(0, Ordering::AcqRel) == 1
+        let mask = self.mask();
+        self.ready_word().fetch_and(!mask, Ordering::AcqRel) & mask != 0
+    }
+
+    /// The ready word hosted by this context, to be handed to [GenericContext::attach].
+    pub(crate) fn hosted_block(&self) -> NonNull<AtomicU32> {
+        NonNull::from(&self.ready_block)
+    }
+
+    /// Clear the ready word hosted by this context and return the previously
+    /// set bits.
+    pub(crate) fn take_block(&self) -> u32 {
+        self.ready_block.swap(0, Ordering::AcqRel)
+    }
+
+    /// Return the ready tasks of the block hosted by this context, without
+    /// clearing them.
+    pub(crate) fn peek_block(&self) -> u32 {
+        self.ready_block.load(Ordering::Acquire)
+    }
+
+    /// Mark the given tasks of the block hosted by this context as ready again,
+    /// e.g. after they were taken with [GenericContext::take_block] but not polled.
+    pub(crate) fn restore_block(&self, ready: u32) {
+        self.ready_block.fetch_or(ready, Ordering::Release);
+    }
+
+    /// Grant the task a fresh budget before it is polled.
+    pub(crate) fn reset_budget(&self, budget: u16) {
+        self.budget.store(budget, Ordering::Relaxed);
+        self.exhausted.store(false, Ordering::Relaxed);
+    }
+
+    /// Consume one unit of budget; returns false if none was left.
+    ///
+    /// The budget is only accessed by the executor and the task it polls, never
+    /// concurrently, so there is no need for atomic read-modify-write operations.
+    pub(crate) fn consume_budget(&self) -> bool {
+        match self.budget.load(Ordering::Relaxed) {
+            0 => {
+                self.exhausted.store(true, Ordering::Relaxed);
+                false
+            },
+            budget => {
+                self.budget.store(budget - 1, Ordering::Relaxed);
+                true
+            },
+        }
+    }
+
+    /// Give back one unit consumed by [GenericContext::consume_budget].
+    pub(crate) fn refund_budget(&self) {
+        let budget = self.budget.load(Ordering::Relaxed);
+        self.budget.store(budget.saturating_add(1), Ordering::Relaxed);
+    }
+
+    /// Whether the task ran out of budget since the last [GenericContext::reset_budget].
+    pub(crate) fn budget_exhausted(&self) -> bool {
+        self.exhausted.load(Ordering::Relaxed)
     }
 }
 
@@ -58,8 +218,7 @@ impl GenericContext {
 /// by wrapping it in a [static_cell::StaticCell].
 #[pin_project::pin_project]
 pub struct TaskStorage<F: Future, E: RawExecutor> {
-    waker_data: WakerStorage<E>,
-    was_initialized: bool,
+    waker_data: WakerStorage<E::TaskLocalData>,
     #[pin]
     future: F,
 }
@@ -74,7 +233,6 @@ where
         TaskStorage {
             waker_data: WakerStorage::new(),
             future,
-            was_initialized: false,
         }
     }
 
@@ -83,15 +241,39 @@ where
     /// # Panics
     /// This will panic if called twice.
     pub fn init(&'static mut self, local_data: E::TaskLocalData) -> &'static mut Self {
-        assert!(!self.was_initialized, "This function can only be called once");
+        self.waker_data.init(local_data);
 
-        // SAFETY: We only call this function once, and the pointer has a static
-        // lifetime.
-        unsafe {
-            WakerStorage::init(NonNull::from(&mut self.waker_data), local_data);
+        self
+    }
+
+    /// Executor facing handle of this task.
+    ///
+    /// Initialized storages have a `'static` lifetime, see [TaskStorage::init].
+    ///
+    /// # Panics
+    /// This will panic if called before [TaskStorage::init].
+    pub(crate) fn task_ref(&self) -> TaskRef<E> {
+        TaskRef {
+            storage: self.waker_data.as_ptr(),
         }
+    }
 
-        self
+    /// Executor facing handle of the task behind the pointer, for executors
+    /// keeping their tasks as pointers rather than references.
+    ///
+    /// The handle is derived from the pointer without going through a
+    /// reference to the storage.
+    ///
+    /// # Safety
+    /// The pointer must refer to a storage initialized through
+    /// [TaskStorage::init], which is never moved.
+    pub(crate) unsafe fn raw_task_ref(task: NonNull<Self>) -> TaskRef<E> {
+        // SAFETY: See function documentation.
+        let storage = unsafe { core::ptr::addr_of_mut!((*task.as_ptr()).waker_data) };
+        TaskRef {
+            // SAFETY: Derived from a non-null pointer.
+            storage: unsafe { NonNull::new_unchecked(storage) },
+        }
     }
 }
 
@@ -100,18 +282,12 @@ where
     E: RawExecutor,
     F: Future<Output = R>,
 {
-    fn local_data(self: Pin<&mut Self>) -> &mut E::TaskLocalData {
-        let this = self.project();
-        this.waker_data.local_data()
-    }
-
-    fn waker_context(&self) -> &GenericContext {
-        self.waker_data.waker_context()
-    }
-
     fn poll(self: Pin<&mut Self>) -> Poll<R> {
         let this = self.project();
-        let mut context = Context::from_waker(this.waker_data.waker());
+        // SAFETY: Tasks are only polled once initialized, which requires a
+        // `'static` lifetime, and they are pinned.
+        let waker = unsafe { this.waker_data.waker() };
+        let mut context = Context::from_waker(&waker);
 
         Future::poll(this.future, &mut context)
     }
@@ -1,66 +1,174 @@
 //! Waker implementation.
-use core::any::Any;
+use core::ptr;
+use core::sync::atomic::{AtomicPtr, Ordering};
 use core::task::{Context, Poll, RawWaker, RawWakerVTable, Waker};
 
 pub(crate) mod storage;
 
-use storage::WakerRef;
+use storage::{TaskHeader, WakerStorage};
+
+use super::task::GenericContext;
+
+/// Number of local data types the executors of a program may use.
+const LOCAL_DATA_TYPES: usize = 4;
+
+/// Type of the [local data](super::RawExecutor::TaskLocalData) of the tasks of
+/// an executor.
+///
+/// Every type has a waker vtable of its own, so a waker tells the type of the
+/// local data it gives access to by its vtable alone; [with_local_data] thus
+/// only compares the vtable before accessing the local data. Implement this
+/// through [task_local_data](crate::task_local_data).
+///
+/// # Safety
+/// [LocalData::vtable] must always return the same static, created through
+/// [waker_vtable] for this type and not used for any other type.
+pub unsafe trait LocalData: 'static {
+    /// Returns the waker vtable of this type.
+    fn vtable() -> &'static RawWakerVTable;
+}
+
+/// Implement [LocalData] for the given types.
+///
+/// ```ignore
+/// struct MyData {
+///     // ...
+/// }
+///
+/// task_local_data!(MyData);
+/// ```
+#[macro_export]
+macro_rules! task_local_data {
+    ($($local_data:ty),+ $(,)?) => {
+        $(
+            // SAFETY: The vtable is a static of its own, created for this type.
+            unsafe impl $crate::executor::task::LocalData for $local_data {
+                fn vtable() -> &'static ::core::task::RawWakerVTable {
+                    static VTABLE: ::core::task::RawWakerVTable = $crate::executor::task::waker_vtable::<$local_data>();
+                    &VTABLE
+                }
+            }
+        )+
+    };
+}
+
+/// Create the waker vtable of a local data type, see [task_local_data](crate::task_local_data).
+#[doc(hidden)]
+pub const fn waker_vtable<L: LocalData>() -> RawWakerVTable {
+    RawWakerVTable::new(clone::<L>, wake, wake_by_ref, drop)
+}
 
 /// Allows access to the current task local data.
 ///
 /// # Panics
-/// This function will panic if not called from within the executor, or when
-/// the type expected as local context was not correct
-pub fn with_local_data<F, R, L: Any>(mut callback: F, cx: &Context<'_>) -> Poll<R>
+/// This function will panic if not called from within an executor of this
+/// crate whose tasks have local data of type `L`
+pub fn with_local_data<F, R, L: LocalData>(mut callback: F, cx: &Context<'_>) -> Poll<R>
 where
     F: FnMut(&mut L) -> Poll<R>,
 {
     let waker = cx.waker().as_raw();
-    if waker.vtable() != &VTABLE {
-        panic!("This function can only be called from within veecle-pxros")
+    if !ptr::eq(waker.vtable(), L::vtable()) {
+        panic!("This function can only be called from within veecle-pxros, with the local data of the executor")
     }
 
-    let context = waker.data();
     // SAFETY: This is safe as our waker adheres to the rules of RawWaker, the reference
-    // to the context is static and the data the reference points to is Sync.
-    let context = unsafe { &*(context as *const WakerRef) };
-
-    // SAFETY: The local function is only called in the context of a task
-    // here, and since we are not calling an async function there can be no
-    // reentrancy.
-    let context = unsafe { context.local() };
-    callback(context.downcast_mut().expect("Unexpected local context type"))
+    // to the header is static and the data the reference points to is Sync.
+    let header = unsafe { &*(waker.data() as *const TaskHeader) };
+
+    // SAFETY: The vtable of `L` is only used by wakers of storages holding
+    // initialized local data of type `L`. The local function is only called in
+    // the context of a task here, and since we are not calling an async function
+    // there can be no reentrancy.
+    let local_data = unsafe { WakerStorage::<L>::from_header(header).local_data() };
+    callback(local_data)
 }
 
-/// Create a new [Waker] from a [WakerRef].
-pub(crate) fn new_waker(context: &'static WakerRef) -> Waker {
-    // Keep this here to make sure nobody makes WakerRef non-Sync by accident
+/// Run a closure on the generic context of the current task.
+///
+/// Returns `None` if the task is not run by an executor of this crate.
+pub(crate) fn with_generic_context<F, R>(callback: F, cx: &Context<'_>) -> Option<R>
+where
+    F: FnOnce(&GenericContext) -> R,
+{
+    let waker = cx.waker().as_raw();
+    if !is_registered(waker.vtable()) {
+        return None;
+    }
+
+    // SAFETY: This is safe as our waker adheres to the rules of RawWaker, the reference
+    // to the header is static and the data the reference points to is Sync.
+    let header = unsafe { &*(waker.data() as *const TaskHeader) };
+    Some(callback(header.waker_context()))
+}
+
+/// Create a new [Waker] from a [TaskHeader] followed by local data of type `L`.
+pub(crate) fn new_waker<L: LocalData>(header: &'static TaskHeader) -> Waker {
+    // Keep this here to make sure nobody makes TaskHeader non-Sync by accident
     fn assert_is_sync<T: Sync>(_: &T) {}
-    assert_is_sync(context);
+    assert_is_sync(header);
 
-    // SAFETY: Our waker adheres to the rules of RawWaker, the reference to the context
+    // SAFETY: Our waker adheres to the rules of RawWaker, the reference to the header
     // is static and the data the reference points to is Sync
-    unsafe { Waker::from_raw(RawWaker::new(context as *const WakerRef as *const (), &VTABLE)) }
+    unsafe { Waker::from_raw(RawWaker::new(header as *const TaskHeader as *const (), L::vtable())) }
+}
+
+/// Vtables of the local data types in use, which identify the wakers of this
+/// crate, see [with_generic_context].
+static VTABLES: [AtomicPtr<RawWakerVTable>; LOCAL_DATA_TYPES] = [UNUSED; LOCAL_DATA_TYPES];
+
+/// Allows us to create an array of entries even if they are not copy.
+#[allow(clippy::declare_interior_mutable_const)]
+const UNUSED: AtomicPtr<RawWakerVTable> = AtomicPtr::new(ptr::null_mut());
+
+/// Register the vtable of a local data type, once local data of this type was
+/// initialized.
+///
+/// # Panics
+/// This will panic if the executors of the program use more than
+/// [LOCAL_DATA_TYPES] local data types.
+pub(crate) fn register_vtable<L: LocalData>() {
+    let vtable = L::vtable() as *const RawWakerVTable as *mut RawWakerVTable;
+
+    for entry in VTABLES.iter() {
+        match entry.compare_exchange(ptr::null_mut(), vtable, Ordering::AcqRel, Ordering::Acquire) {
+            Ok(_) => return,
+            Err(registered) if registered == vtable => return,
+            Err(_) => {},
+        }
+    }
+
+    panic!("Too many local data types in use")
 }
 
-const VTABLE: RawWakerVTable = RawWakerVTable::new(clone, wake, wake_by_ref, drop);
+/// Returns true if the vtable belongs to a waker of this crate.
+fn is_registered(vtable: &RawWakerVTable) -> bool {
+    VTABLES
+        .iter()
+        .map(|entry| entry.load(Ordering::Acquire))
+        .take_while(|registered| !registered.is_null())
+        .any(|registered| ptr::eq(registered, vtable))
+}
 
-unsafe fn clone(data: *const ()) -> RawWaker {
-    RawWaker::new(data, &VTABLE)
+unsafe fn clone<L: LocalData>(data: *const ()) -> RawWaker {
+    RawWaker::new(data, L::vtable())
 }
 
 unsafe fn wake(data: *const ()) {
     // SAFETY: This is safe as our waker adheres to the rules of RawWaker, the reference
-    // to the context is static and the data the reference points to is Sync.
-    let data = unsafe { &*(data as *const WakerRef) };
+    // to the header is static and the data the reference points to is Sync.
+    let data = unsafe { &*(data as *const TaskHeader) };
     data.waker_context().mark_ready()
 }
 
 unsafe fn wake_by_ref(data_ref: *const ()) {
     // SAFETY: This is safe as our waker adheres to the rules of RawWaker, the reference
-    // to the context is static and the data the reference points to is Sync.
-    let data_ref = unsafe { &*(data_ref as *const WakerRef) };
+    // to the header is static and the data the reference points to is Sync.
+    let data_ref = unsafe { &*(data_ref as *const TaskHeader) };
     data_ref.waker_context().mark_ready()
 }
 
 unsafe fn drop(_: *const ()) {}
+
+#[cfg(test)]
+crate::task_local_data!(());
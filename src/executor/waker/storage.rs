@@ -1,159 +1,157 @@
 //! Waker storage.
-use core::any::Any;
+use core::cell::UnsafeCell;
+use core::mem::MaybeUninit;
 use core::ptr::NonNull;
 use core::task::Waker;
 
-use super::new_waker;
+use super::{new_waker, register_vtable, LocalData};
 use crate::executor::task::GenericContext;
-use crate::executor::RawExecutor;
+
+/// Type independent part of a [WakerStorage]; this is what wakers point to.
+#[repr(C)]
+pub(crate) struct TaskHeader {
+    /// The generic context; wakers only access this field.
+    waker_context: GenericContext,
+}
+
+impl TaskHeader {
+    /// Return a reference to the generic context.
+    pub(crate) fn waker_context(&self) -> &GenericContext {
+        &self.waker_context
+    }
+}
 
 /// This structure can be used to generate a waker that provides access to the given
-/// [executor specific local context](RawExecutor::TaskLocalData) and the [generic context](GenericContext).
+/// [executor specific local context](crate::executor::RawExecutor::TaskLocalData) and
+/// the [generic context](GenericContext).
 ///
-/// # Note
-/// The internal fields are all optional, for performance reasons this can be changed to
-/// a [core::mem::MaybeUninit] since any panicking methods are not supposed to be called
-/// before the fields are initialized.
-pub(crate) struct WakerStorage<E: RawExecutor> {
-    local_data: Option<E::TaskLocalData>,
-    waker_context: Option<GenericContext>,
-    waker_ref: Option<WakerRef>,
-    waker: Option<Waker>,
+/// The layout is a [TaskHeader] followed by the local data, so a pointer to
+/// the header can be turned back into a pointer to the storage; the type of the
+/// local data is told by the vtable of the waker, see [LocalData]. Wakers are
+/// created on demand instead of being stored. The per-task overhead on top of
+/// the local data is the size of the header and the initialization flag: 20
+/// bytes on 32 bit targets.
+#[repr(C)]
+pub(crate) struct WakerStorage<L> {
+    header: TaskHeader,
+    local_data: UnsafeCell<MaybeUninit<L>>,
+    initialized: bool,
 }
 
-impl<E: RawExecutor> WakerStorage<E> {
-    /// Create a new context.
+impl<L: LocalData> WakerStorage<L> {
+    /// Create a new storage.
     ///
     /// Before doing anything with this structure, [WakerStorage::init] should be
     /// called for it.
     pub const fn new() -> Self {
         WakerStorage {
-            local_data: None,
-            waker_context: None,
-            waker: None,
-            waker_ref: None,
+            header: TaskHeader {
+                waker_context: GenericContext::new(),
+            },
+            local_data: UnsafeCell::new(MaybeUninit::uninit()),
+            initialized: false,
         }
     }
 
-    /// Initialize a waker from a context and local data.
-    ///
-    /// # Safety
-    /// The pointer passed must be aligned, point to a initialized instance of
-    /// a [WakerStorage] and not be aliased when calling this function. It captures
-    /// a `'static`, immutable reference to that structure. Stated explicitely:
-    /// The pointer must have a `'static` lifetime.
+    /// Initialize the local data.
     ///
-    /// Effectively the user must consider the reference to self to be a `&mut self`,
-    /// while after that only methods with `&self` as a receiver must be called.
-    /// In particular, calling [WakerStorage::waker()] is safe.
+    /// # Panics
+    /// This will panic if called twice, or if the executors of the program use
+    /// too many local data types.
+    pub fn init(&mut self, local_data: L) {
+        assert!(!self.initialized, "This function can only be called once");
+
+        register_vtable::<L>();
+        self.local_data.get_mut().write(local_data);
+        self.initialized = true;
+    }
+
+    /// Create a waker for usage in an asynchronous executor.
     ///
-    /// This implies that this function is only called once, and that the pointer
-    /// can safely dereferenced to a `&mut self` in this function
-    pub unsafe fn init(mut this: NonNull<WakerStorage<E>>, local_data: E::TaskLocalData)
-    where
-        E: 'static,
-    {
+    /// # Safety
+    /// The storage must have a `'static` lifetime and must not be moved anymore.
+    pub unsafe fn waker(&self) -> Waker {
         // SAFETY: See function documentation
-        let this = unsafe { this.as_mut() };
-
-        this.local_data = Some(local_data);
-        this.waker_context = Some(GenericContext::default());
-
-        // SAFETY: We never access the fields local_data and global_context
-        // after this
-        let waker_data = unsafe {
-            WakerRef::new(
-                NonNull::from(this.local_data.as_ref().unwrap()),
-                NonNull::from(this.waker_context.as_ref().unwrap()),
-            )
-        };
-        this.waker_ref = Some(waker_data);
-
-        let waker = new_waker(this.waker_ref.as_ref().unwrap());
-
-        this.waker = Some(waker);
+        new_waker::<L>(unsafe { &*(&self.header as *const TaskHeader) })
     }
 
-    /// Reference to the waker for usage in an asynchronous executor.
+    /// Executor facing pointer to this storage.
     ///
     /// # Panics
     /// This will panic if called before [WakerStorage::init].
-    pub fn waker(&self) -> &Waker {
-        self.waker.as_ref().unwrap()
+    pub fn as_ptr(&self) -> NonNull<Self> {
+        assert!(self.initialized, "No context registered");
+
+        NonNull::from(self)
     }
 
     /// Access to the context that is also available to the Waker.
-    ///
-    /// # Panics
-    /// This will panic if called before [WakerStorage::init].
     pub fn waker_context(&self) -> &GenericContext {
-        self.waker_context.as_ref().unwrap()
+        self.header.waker_context()
     }
 
-    /// Mutably access the local data.
+    /// Provide access to the local data.
     ///
-    /// # Panics
-    /// This will panic if called before [WakerStorage::init].
-    pub fn local_data(&mut self) -> &mut E::TaskLocalData {
-        unsafe {
-            self.waker_ref
-                .as_ref()
-                .expect("No context registered")
-                .local()
-                .downcast_mut()
-                .expect("Inconsistent state, waker not as expected")
-        }
+    /// # Safety
+    /// The storage must be initialized, and the local data must not be accessed
+    /// by anyone else for the lifetime of the returned reference. In specific:
+    /// - This function must not be called re-entrantely on the same storage
+    /// - This function must be called from the same context where the storage was created, because the local data is
+    ///   actually not [Send]/[Sync]
+    #[allow(clippy::mut_from_ref)]
+    pub unsafe fn local_data(&self) -> &mut L {
+        // SAFETY: See function documentation
+        unsafe { (*self.local_data.get()).assume_init_mut() }
     }
-}
 
-/// This is the structure which is pointed to by the waker.
-///
-/// It allows to safely erase the types and access them from the context of a
-/// waker.
-///
-/// This is an intermediate step because `*mut dyn Any` is a fat pointer which
-/// can not be stored in the data field for the waker.
-pub(crate) struct WakerRef {
-    local: NonNull<dyn Any>,
-    flag: NonNull<GenericContext>,
-}
-
-impl WakerRef {
-    /// Create a new instance from a context.
+    /// Turn a header back into its storage.
     ///
     /// # Safety
-    /// The local pointer must be not aliased and have a static lifetime
-    /// The pointer to the generic context may be aliased, but also must have a static lifetime
-    pub(crate) unsafe fn new(local: NonNull<dyn Any>, flag: NonNull<GenericContext>) -> Self {
-        WakerRef { local, flag }
+    /// The header must be part of a [WakerStorage] with local data of type `L`;
+    /// this is the case for the header of a waker with the vtable of `L`.
+    pub unsafe fn from_header(header: &TaskHeader) -> &Self {
+        // SAFETY: The header is the first field of this `repr(C)` structure.
+        unsafe { &*(header as *const TaskHeader as *const Self) }
     }
+}
 
-    /// Return a reference to the generic context.
-    pub(crate) fn waker_context(&self) -> &GenericContext {
-        // SAFETY: The pointer may always be dereferenced since it has a static lifetime
-        // Check the `new` constructor
-        unsafe { self.flag.as_ref() }
+impl<L> Drop for WakerStorage<L> {
+    fn drop(&mut self) {
+        if self.initialized {
+            // SAFETY: The local data is initialized and never accessed again.
+            unsafe { self.local_data.get_mut().assume_init_drop() }
+        }
     }
+}
 
-    /// Provide access to the local waker data
-    ///
-    /// # Safety
-    /// The user must guarantee mutable access to the `local` part of this struct,
-    /// In specific:
-    /// - This function must not be called re-entrantely on the same waker data structure
-    /// - This function must be called from the same context where WakerData was created. This is because the `local`
-    ///   part of this structure is actually not [Send]/[Sync]
-    #[allow(clippy::mut_from_ref)]
-    pub unsafe fn local(&self) -> &mut dyn Any {
-        // SAFETY: The pointer is always valid, and we can assume this function
-        // not be called reentrantely
-        unsafe { &mut *self.local.as_ptr() }
+#[cfg(test)]
+mod tests {
+    use core::mem::size_of;
+    use core::task::{Context, Poll};
+
+    use super::{TaskHeader, WakerStorage};
+    use crate::executor::task::with_local_data;
+
+    #[test]
+    fn overhead() {
+        // The generic context takes a word, the ready bit and budget packed in
+        // another word, and two pointers; the initialization flag is padded to a
+        // pointer.
+        let words = size_of::<u32>() + size_of::<u8>() + size_of::<u16>() + size_of::<bool>();
+        assert_eq!(size_of::<TaskHeader>(), words.next_multiple_of(size_of::<usize>()) + 2 * size_of::<usize>());
+        assert_eq!(size_of::<WakerStorage<usize>>(), size_of::<TaskHeader>() + 2 * size_of::<usize>());
     }
-}
 
-// SAFETY: The `global` part is Send and Sync, and the `local` part can only be
-// accessed in a non Send/Sync manner
-unsafe impl Send for WakerRef {}
-// SAFETY: The `global` part is Send and Sync, and the `local` part can only be
-// accessed in a non Send/Sync manner
-unsafe impl Sync for WakerRef {}
+    #[test]
+    #[should_panic(expected = "with the local data of the executor")]
+    fn wakers_tell_the_type_of_the_local_data() {
+        let storage = Box::leak(Box::new(WakerStorage::<()>::new()));
+        storage.init(());
+        // SAFETY: The storage is leaked and never moved.
+        let waker = unsafe { storage.waker() };
+        let cx = Context::from_waker(&waker);
+
+        assert!(with_local_data(|_: &mut ()| Poll::Ready(()), &cx).is_ready());
+        let _ = with_local_data(|_: &mut u32| Poll::Ready(()), &cx);
+    }
+}
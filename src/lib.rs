@@ -62,6 +62,7 @@
 //!
 //! Additional examples can be found in the examples folder.
 #![cfg_attr(not(test), no_std)]
+#![cfg_attr(test, feature(test))]
 #![feature(waker_getters)]
 #![feature(type_alias_impl_trait)]
 #![feature(macro_metavar_expr)]
@@ -43,7 +43,7 @@ use pxros::bindings::{PxAbort, PxError_t, PxGetId};
 
 use super::tsim;
 use crate::pxros::ticker::Ticker;
-use crate::pxros::time::time_since_boot;
+use crate::pxros::time;
 
 bitflags::bitflags! {
     /// Used for waiting on the defmt global logger lock.
@@ -63,7 +63,10 @@ static LOGGER_TAKEN_BY_TASK_ID: AtomicU16 = AtomicU16::new(0);
 const DEFMT_BUF_SIZE: usize = 1024;
 
 // Configure the timestamp
-defmt::timestamp!("{=u64:us}", { time_since_boot().as_micros() as u64 });
+#[cfg(not(feature = "stm-timestamps"))]
+defmt::timestamp!("{=u64:us}", { time::time_since_boot().as_micros() as u64 });
+#[cfg(feature = "stm-timestamps")]
+defmt::timestamp!("{=u64:us}", { time::Instant::now().ticks() / (time::STM_FREQUENCY / 1_000_000) });
 
 /// Write log data into the output buffer.
 #[inline]
@@ -0,0 +1,278 @@
+//! Reusable one-shot delays.
+//!
+//! Sleeping with a fresh kernel object requests and releases it on every call;
+//! [Delay] keeps its timeout object across sleeps instead. Code that does not
+//! own a [Delay], e.g. the logger, can use the one cached for the calling task
+//! through [sleep_cached].
+
+use core::cell::UnsafeCell;
+use core::sync::atomic::{AtomicU32, Ordering};
+use core::time::Duration;
+
+use heapless::Vec;
+use pxros::bindings::{
+    PxAwaitEvents,
+    PxEvents_t,
+    PxGetId,
+    PxOpool_t,
+    PxTicks_t,
+    PxToRelease,
+    PxToRequest,
+    PxToStart,
+    PxToStop,
+    PxTo_t,
+};
+use pxros::PxResult;
+
+use super::events::Event;
+use super::time::duration_to_ticks;
+
+/// Number of tasks that can have a delay cached at the same time.
+///
+/// Tasks beyond this number fall back to a temporary [Delay] per sleep.
+pub const DELAY_CACHE_SIZE: usize = 16;
+
+/// Number of delays, each for an event and a duration, cached for a task.
+///
+/// Beyond this number, the least recently used delay of the task is replaced.
+pub const DELAYS_PER_TASK: usize = 4;
+
+/// A one-shot delay that can be slept on repeatedly.
+///
+/// The timeout object is requested once and restarted on every sleep. A timeout
+/// object cannot change its duration, so a new one is requested only when the
+/// duration differs from the previous sleep.
+///
+/// ```ignore
+/// let mut delay = Delay::new(TaskEvent::Delay, Duration::from_millis(5))?;
+/// loop {
+///     delay.sleep()?;
+///     // ...
+/// }
+/// ```
+///
+/// ## Note
+/// Memory pools are current not supported (the default task pool is
+/// used).
+pub struct Delay<E: Event> {
+    event: E,
+    timeout: RawDelay,
+}
+
+impl<E: Event> Delay<E> {
+    /// Create a delay that signals the event once the duration elapsed.
+    ///
+    /// This may return error if [PxToRequest] fails.
+    pub fn new(event: E, duration: Duration) -> PxResult<Self> {
+        let timeout = RawDelay::request(PxEvents_t(event.bits()), duration_to_ticks(duration))?;
+        Ok(Self { event, timeout })
+    }
+
+    /// Sleep in blocking manner for the duration of the delay.
+    ///
+    /// This may return error if [PxToStart] fails.
+    pub fn sleep(&mut self) -> PxResult<()> {
+        self.timeout.sleep()
+    }
+
+    /// Sleep in blocking manner for the given duration, which is kept for
+    /// further sleeps.
+    ///
+    /// This may return error if [PxToRequest] or [PxToStart] fails.
+    pub fn sleep_for(&mut self, duration: Duration) -> PxResult<()> {
+        self.timeout.set_ticks(duration_to_ticks(duration))?;
+        self.timeout.sleep()
+    }
+
+    /// Returns the event owned by the delay
+    pub const fn event(&self) -> E {
+        self.event
+    }
+}
+
+/// Sleep in blocking manner for the given duration, reusing the timeout object
+/// cached for the calling task.
+///
+/// The first sleep of a task claims one of [DELAY_CACHE_SIZE] cache slots. A
+/// slot keeps up to [DELAYS_PER_TASK] timeout objects, one per event and
+/// duration, so a task alternating between a few of them requests each object
+/// once. Tasks give their slot back through [release_cached] once they end,
+/// which [PxrosTask](crate::pxros::task::PxrosTask) does by default.
+///
+/// This may return error if [PxToRequest] or [PxToStart] fails.
+pub fn sleep_cached<E: Event>(event: E, duration: Duration) -> PxResult<()> {
+    let events = PxEvents_t(event.bits());
+    let ticks = duration_to_ticks(duration);
+
+    let Some(slot) = CacheSlot::claim(PxGetId().as_raw()) else {
+        return RawDelay::request(events, ticks)?.sleep();
+    };
+
+    // Safety: only the task owning the slot accesses its delays.
+    let delays = unsafe { &mut *slot.delays.get() };
+
+    // The least recently used delay comes first
+    let cached = delays
+        .iter()
+        .position(|delay| delay.events.0 == events.0 && delay.ticks.0 == ticks.0);
+    let mut delay = match cached {
+        Some(index) => delays.remove(index),
+        None => {
+            // Release the least recently used object before requesting the new one
+            if delays.is_full() {
+                drop(delays.remove(0));
+            }
+            RawDelay::request(events, ticks)?
+        },
+    };
+
+    let result = delay.sleep();
+    // Cannot fail, a delay was just taken or there is room
+    let _ = delays.push(delay);
+    result
+}
+
+/// Release the timeout objects cached for the calling task, if any, and give its
+/// slot back.
+///
+/// Task ids are reused once a task ended, so a task ending without calling this
+/// leaves its objects to the next task with the same id; see
+/// [discard_stale_cache].
+pub fn release_cached() {
+    let task = PxGetId().as_raw();
+
+    if let Some(slot) = CacheSlot::owned_by(task) {
+        // Safety: only the task owning the slot accesses its delays.
+        unsafe { (*slot.delays.get()).clear() };
+        slot.owner.store(0, Ordering::Release);
+    }
+}
+
+/// Give back the slot left by a previous task with the id of the calling one.
+///
+/// The timeout objects of the slot signal the previous task, so they must not
+/// be reused; they are released if the kernel permits it and dropped otherwise.
+/// To be called when a task starts, which
+/// [PxrosTask](crate::pxros::task::PxrosTask) does by default.
+pub fn discard_stale_cache() {
+    let task = PxGetId().as_raw();
+
+    if let Some(slot) = CacheSlot::owned_by(task) {
+        // Safety: the previous owner ended, the calling task took its id.
+        let delays = unsafe { &mut *slot.delays.get() };
+        while let Some(delay) = delays.pop() {
+            if let Err(error) = delay.release() {
+                defmt::warn!("Stale timeout object could not be released: {}", error);
+            }
+        }
+        slot.owner.store(0, Ordering::Release);
+    }
+}
+
+/// Timeout object signalling events after a fixed number of ticks.
+struct RawDelay {
+    handle: PxTo_t,
+    events: PxEvents_t,
+    ticks: PxTicks_t,
+}
+
+impl RawDelay {
+    /// Request a timeout object from the default task pool.
+    fn request(events: PxEvents_t, ticks: PxTicks_t) -> PxResult<Self> {
+        // Safety: safe to call from any context, errors are checked.
+        let handle = unsafe { PxToRequest(PxOpool_t::default(), ticks, events) }.checked()?;
+        Ok(Self { handle, events, ticks })
+    }
+
+    /// Make sure the next sleep lasts the given number of ticks.
+    fn set_ticks(&mut self, ticks: PxTicks_t) -> PxResult<()> {
+        if self.ticks.0 != ticks.0 {
+            // The timeout of an object is fixed on request; the previous object
+            // is released once replaced
+            *self = Self::request(self.events, ticks)?;
+        }
+        Ok(())
+    }
+
+    /// Stop and release the timeout object, reporting failures instead of
+    /// panicking; the object is given up either way.
+    fn release(self) -> PxResult<()> {
+        let handle = self.handle;
+        core::mem::forget(self);
+
+        // Safety: PxTo_t known to be a valid object; stopping an expired
+        // timeout has no effect.
+        let _ = unsafe { PxToStop(handle) };
+        // Safety: PxTo_t known to be a valid object, errors are checked.
+        unsafe { PxToRelease(handle) }.checked().map(|_| ())
+    }
+
+    /// Start the timeout and wait for its events.
+    fn sleep(&mut self) -> PxResult<()> {
+        // Safety: PxTo_t known to be a valid object; starting an expired
+        // timeout starts it again.
+        PxResult::from(unsafe { PxToStart(self.handle) })?;
+
+        // Safety: the events are not zero, otherwise the request had failed.
+        let received = unsafe { PxAwaitEvents(self.events) };
+        if received.0 != self.events.0 {
+            defmt::panic!("Received unexpected event {}, expected {}", received.0, self.events.0);
+        }
+        Ok(())
+    }
+}
+
+impl Drop for RawDelay {
+    fn drop(&mut self) {
+        // Safety: PxTo_t known to be a valid object; stopping an expired
+        // timeout has no effect.
+        let _ = unsafe { PxToStop(self.handle) };
+        // Safety: we cannot handle failures yet, so we panic in case we fail
+        // at releasing the object.
+        let _ = unsafe { PxToRelease(self.handle) }
+            .checked()
+            .expect("Failed at releasing PxTo_t");
+    }
+}
+
+/// Delays cached for one task, least recently used first.
+struct CacheSlot {
+    /// Raw id of the owning task, 0 if free.
+    owner: AtomicU32,
+    /// Only accessed by the owning task.
+    delays: UnsafeCell<Vec<RawDelay, DELAYS_PER_TASK>>,
+}
+
+// Safety: the delays are only accessed by the task owning the slot, see CacheSlot::claim.
+unsafe impl Sync for CacheSlot {}
+
+impl CacheSlot {
+    /// Allows us to create an array of slots even if they are not copy.
+    #[allow(clippy::declare_interior_mutable_const)]
+    const FREE: CacheSlot = CacheSlot {
+        owner: AtomicU32::new(0),
+        delays: UnsafeCell::new(Vec::new()),
+    };
+
+    /// Return the slot owned by the task, if any.
+    fn owned_by(task: u32) -> Option<&'static CacheSlot> {
+        DELAY_CACHE
+            .iter()
+            .find(|slot| slot.owner.load(Ordering::Acquire) == task)
+    }
+
+    /// Return the slot owned by the task, claiming a free one if needed.
+    fn claim(task: u32) -> Option<&'static CacheSlot> {
+        if let Some(slot) = Self::owned_by(task) {
+            return Some(slot);
+        }
+
+        DELAY_CACHE.iter().find(|slot| {
+            slot.owner
+                .compare_exchange(0, task, Ordering::AcqRel, Ordering::Relaxed)
+                .is_ok()
+        })
+    }
+}
+
+static DELAY_CACHE: [CacheSlot; DELAY_CACHE_SIZE] = [CacheSlot::FREE; DELAY_CACHE_SIZE];
@@ -11,6 +11,7 @@ use pxros::PxResult;
 use super::executor::local_data::wait_for_event;
 use super::messages::{NewMessageEvents, RawMessage};
 use super::name_server::{NameServer, TaskName};
+use crate::executor::budget::poll_budgeted;
 
 /// Specialized trait compatible with PXROS events (u32).
 ///
@@ -135,6 +136,19 @@ impl<E: Event> Receiver<E> {
         }
     }
 
+    /// Receives a message or any of the given events in blocking manner.
+    ///
+    /// Unlike [Receiver::receive], this waits for raw events which need not be
+    /// part of `E`.
+    pub(crate) fn receive_raw(&mut self, events: PxEvents_t) -> (PxEvents_t, Option<RawMessage>) {
+        match RawMessage::receive_with_events(self.mailbox, events) {
+            Ok(NewMessageEvents::Message(message)) => (PxEvents_t(0), Some(message)),
+            Ok(NewMessageEvents::Events(events)) => (events, None),
+            Ok(NewMessageEvents::Both((message, events))) => (events, Some(message)),
+            Err(_) => (PxEvents_t(0), None),
+        }
+    }
+
     /// Tries to receive a message in non-blocking manner.
     ///
     /// This method does not check for events.
@@ -167,9 +181,11 @@ impl<E: Event> Stream for AsyncEventReceiver<E> {
     type Item = ();
 
     fn poll_next(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<Option<Self::Item>> {
-        let future = wait_for_event(self.event);
-        pin_mut!(future);
+        poll_budgeted(cx, |cx| {
+            let future = wait_for_event(self.event);
+            pin_mut!(future);
 
-        future.poll(cx).map(Some)
+            future.poll(cx).map(Some)
+        })
     }
 }
@@ -1,10 +1,32 @@
 //! Data stored in the Waker, defined by a task and used in asynchronous contexts.
 
 use core::future::poll_fn;
-use core::task::{Context, Poll};
+use core::task::{Context, Poll, Waker};
+
+use heapless::Deque;
+use pxros::bindings::PxTicks_t;
 
 use crate::pxros::events::Event;
-use crate::pxros::messages::RawMessage;
+use crate::pxros::messages::{MessageFilter, RawMessage};
+use crate::pxros::time::ticks_reached;
+
+/// Number of messages a task can have pending in its inbox.
+///
+/// Messages arriving in a burst are delivered to the inboxes of their tasks in
+/// one go; once the inbox of a task is full, further messages for it are held
+/// back by the executor until it made room.
+pub const INBOX_SIZE: usize = 4;
+
+/// Outcome of [PxrosData::deliver_message].
+pub enum Delivery {
+    /// The message was added to the inbox; true if the task awaits it and
+    /// shall be polled.
+    Delivered(bool),
+    /// The task receives the message, but its inbox is full.
+    Full(RawMessage),
+    /// The task does not receive the message.
+    Rejected(RawMessage),
+}
 
 /// Task-specific context used by the executor to provide async
 /// functionalities.
@@ -19,16 +41,24 @@ pub struct PxrosData {
     awaiting_events: u32,
     /// Lists all events that have been triggered for the task
     ///
-    /// This field is _set_ by the executor and _cleared_ by the task logic
+    /// This field is _set_ by the executor and _cleared_ by the task logic;
+    /// occurrences not consumed yet are merged
     triggered_events: u32,
     /// If true it means this task is awaiting a message; this must be _set_
     /// by the task logic and and _cleared_ by the executor
     awaiting_message: bool,
-    /// Message payload that shall be filled by the executor when clearing the
-    /// _message_ flag
-    message: Option<RawMessage>,
+    /// Messages received by this task, set by the task logic while a
+    /// [MessageRegistration] is in use
+    message_filter: Option<MessageFilter>,
+    /// Messages delivered by the executor and not taken by the task logic yet
+    inbox: Deque<RawMessage, INBOX_SIZE>,
+    /// Earliest deadline of the timers the task is waiting for; this field is
+    /// _set_ by the task logic and _cleared_ by the executor once reached
+    timer_deadline: Option<PxTicks_t>,
 }
 
+crate::task_local_data!(PxrosData);
+
 impl PxrosData {
     /// Run a closure on the task local data.
     ///
@@ -64,13 +94,21 @@ impl PxrosData {
         }
     }
 
-    /// Poll the task for the given message
+    /// Poll the task for a message matching the filter
     ///
     /// This function will return [Poll::Ready] if a message have been
     /// received, otherwise it will return [Poll::Pending] and register
     /// the task to be woken on message reception
-    pub fn poll_message(&mut self) -> Poll<RawMessage> {
-        match self.message.take() {
+    ///
+    /// From now on, messages matching the filter are delivered to the inbox of
+    /// the task even while it does not wait, until [PxrosData::stop_receiving].
+    /// Messages delivered before are returned first if they match the filter;
+    /// the others are handed back to the executor, see
+    /// [PxrosData::take_rejected]
+    pub fn poll_message(&mut self, filter: MessageFilter) -> Poll<RawMessage> {
+        self.message_filter = Some(filter);
+
+        match self.take_from_inbox(|message| filter.matches(message)) {
             Some(message) => {
                 self.awaiting_message = false;
                 Poll::Ready(message)
@@ -82,33 +120,100 @@ impl PxrosData {
         }
     }
 
+    /// Stop delivering messages to the inbox of the task
+    ///
+    /// Messages delivered already stay in the inbox for the next wait
+    pub fn stop_receiving(&mut self) {
+        self.message_filter = None;
+        self.awaiting_message = false;
+    }
+
+    /// Take a message from the inbox that does not match the current filter,
+    /// e.g. delivered under a previous one, so the executor can deliver it to
+    /// another task
+    pub fn take_rejected(&mut self) -> Option<RawMessage> {
+        let filter = self.message_filter?;
+        self.take_from_inbox(|message| !filter.matches(message))
+    }
+
+    /// Take the first message of the inbox the predicate returns true for,
+    /// keeping the order of the others
+    fn take_from_inbox(&mut self, mut predicate: impl FnMut(&RawMessage) -> bool) -> Option<RawMessage> {
+        let mut taken = None;
+
+        for _ in 0..self.inbox.len() {
+            let message = self.inbox.pop_front()?;
+            if taken.is_none() && predicate(&message) {
+                taken = Some(message);
+            } else {
+                // Cannot fail, a message was just taken
+                let _ = self.inbox.push_back(message);
+            }
+        }
+
+        taken
+    }
+
+    /// Poll the task for the given deadline
+    ///
+    /// This function will return [Poll::Ready] if the deadline was reached,
+    /// otherwise it will return [Poll::Pending] and register the task to be
+    /// woken at the deadline
+    pub fn poll_deadline(&mut self, deadline: PxTicks_t, now: PxTicks_t) -> Poll<()> {
+        if ticks_reached(deadline, now) {
+            return Poll::Ready(());
+        }
+
+        // Several timers of the task share the earliest deadline; on wakeup the
+        // others register again
+        self.timer_deadline = match self.timer_deadline {
+            Some(earlier) if ticks_reached(earlier, deadline) => Some(earlier),
+            _ => Some(deadline),
+        };
+        Poll::Pending
+    }
+
     /// Trigger the given events
     ///
     /// Returns whether an event that was awaited for has been triggered
     pub fn trigger_events(&mut self, events: u32) -> bool {
         let relevant_events = events & self.awaiting_events;
         self.awaiting_events ^= relevant_events;
-
-        // TODO What happens when the task doesn't pull a triggered event out
-        // of the context in time?
-        assert!(relevant_events & self.triggered_events == 0, "The context can store only one triggered event");
         self.triggered_events |= relevant_events;
 
         relevant_events != 0
     }
 
-    /// Trigger message reception
+    /// Deliver a message to the inbox if it matches the filter of the task
+    pub fn deliver_message(&mut self, message: RawMessage) -> Delivery {
+        if !self.message_filter.is_some_and(|filter| filter.matches(&message)) {
+            return Delivery::Rejected(message);
+        }
+
+        match self.inbox.push_back(message) {
+            Ok(()) => Delivery::Delivered(core::mem::take(&mut self.awaiting_message)),
+            Err(message) => Delivery::Full(message),
+        }
+    }
+
+    /// Trigger the timer if its deadline was reached
     ///
-    /// Returns true if the message was waiting for
-    pub fn trigger_message(&mut self, message: RawMessage) -> bool {
-        if self.awaiting_message {
-            self.message = Some(message);
-            true
-        } else {
-            false
+    /// Returns whether the task shall be woken
+    pub fn trigger_timer(&mut self, now: PxTicks_t) -> bool {
+        match self.timer_deadline {
+            Some(deadline) if ticks_reached(deadline, now) => {
+                self.timer_deadline = None;
+                true
+            },
+            _ => false,
         }
     }
 
+    /// Return the earliest deadline this task is waiting for
+    pub const fn timer_deadline(&self) -> Option<PxTicks_t> {
+        self.timer_deadline
+    }
+
     /// Return the events being waiting by this task
     pub const fn awaiting_events(&self) -> u32 {
         self.awaiting_events
@@ -118,6 +223,22 @@ impl PxrosData {
     pub const fn awaiting_message(&self) -> bool {
         self.awaiting_message
     }
+
+    /// Return true if messages are delivered to the task
+    pub const fn receives_messages(&self) -> bool {
+        self.message_filter.is_some()
+    }
+}
+
+impl Drop for PxrosData {
+    fn drop(&mut self) {
+        // Messages not taken by the task anymore are released
+        while let Some(mut message) = self.inbox.pop_front() {
+            if let Err(error) = message.release() {
+                defmt::warn!("Message could not be released: {}", error);
+            }
+        }
+    }
 }
 
 /// Async wait for the given event
@@ -132,11 +253,107 @@ pub async fn wait_for_event<E: Event>(event: E) {
 
 /// Wait the task for a message
 ///
-/// # Panics
-/// Within the same executor, only one task can wait for a message at the same time. This
-/// limitation may be lifted in the future if APIs allows for it
-///
-/// If this is not respected, the executor *will* panic
+/// See [wait_for_message_matching] for details; this receives any message.
 pub async fn wait_for_message() -> RawMessage {
-    poll_fn(|cx| PxrosData::access(|data| data.poll_message(), cx)).await
+    wait_for_message_matching(MessageFilter::Any).await
+}
+
+/// Wait the task for a message matching the filter
+///
+/// Several tasks of the same executor can wait for messages at the same time;
+/// every message is delivered to the first one whose filter it matches and
+/// released if there is none. Messages are delivered to the task only while
+/// this waits.
+pub async fn wait_for_message_matching(filter: MessageFilter) -> RawMessage {
+    let mut registration = MessageRegistration::new(filter);
+    poll_fn(|cx| registration.poll_message(cx)).await
+}
+
+/// Registration of a task for the messages matching a filter
+///
+/// Messages are delivered to the task from the first poll on, until the
+/// registration is dropped; see [PxrosData::poll_message]. A task has a
+/// single filter, so it should use one registration at a time.
+#[derive(Debug)]
+pub struct MessageRegistration {
+    filter: MessageFilter,
+    /// Waker of the registered task, to unregister it once dropped
+    waker: Option<Waker>,
+}
+
+impl MessageRegistration {
+    /// Create a registration, to be polled from the task to receive the
+    /// messages.
+    pub const fn new(filter: MessageFilter) -> Self {
+        Self { filter, waker: None }
+    }
+
+    /// Poll the task for a message matching the filter, see
+    /// [PxrosData::poll_message]
+    ///
+    /// # Panics
+    /// This function will panic if called outside the executor.
+    pub fn poll_message(&mut self, cx: &Context<'_>) -> Poll<RawMessage> {
+        if self.waker.is_none() {
+            self.waker = Some(cx.waker().clone());
+        }
+
+        PxrosData::access(|data| data.poll_message(self.filter), cx)
+    }
+}
+
+impl Drop for MessageRegistration {
+    fn drop(&mut self) {
+        if let Some(waker) = self.waker.take() {
+            let cx = Context::from_waker(&waker);
+            let _ = PxrosData::access(
+                |data| {
+                    data.stop_receiving();
+                    Poll::Ready(())
+                },
+                &cx,
+            );
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use core::task::Poll;
+
+    use super::PxrosData;
+
+    bitflags::bitflags! {
+        #[derive(Copy, Clone)]
+        struct TestEvent: u32 {
+            const A = 0b01;
+            const B = 0b10;
+        }
+    }
+
+    #[test]
+    fn repeated_events_are_merged() {
+        let mut data = PxrosData::default();
+
+        assert_eq!(data.poll_event(TestEvent::A), Poll::Pending);
+        assert!(data.trigger_events(TestEvent::A.bits()));
+        // Not awaited anymore, the occurrences merge
+        assert!(!data.trigger_events(TestEvent::A.bits()));
+
+        assert_eq!(data.poll_event(TestEvent::A), Poll::Ready(()));
+        assert_eq!(data.poll_event(TestEvent::A), Poll::Pending);
+    }
+
+    #[test]
+    fn waiting_consumes_all_occurrences() {
+        let mut data = PxrosData::default();
+
+        assert_eq!(data.poll_event(TestEvent::A | TestEvent::B), Poll::Pending);
+        assert!(data.trigger_events(TestEvent::A.bits()));
+        assert!(data.trigger_events(TestEvent::B.bits()));
+        assert!(!data.trigger_events(TestEvent::B.bits()));
+
+        assert_eq!(data.poll_event(TestEvent::A | TestEvent::B), Poll::Ready(()));
+        assert_eq!(data.poll_event(TestEvent::B), Poll::Pending);
+    }
 }
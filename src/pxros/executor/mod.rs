@@ -2,13 +2,93 @@
 //! This module implements an asynchronous executor that implements efficient
 //! asynchronous functionality on top of Pxros.
 pub mod local_data;
+mod timer;
 pub mod util;
 
-use pxros::bindings::PxMbx_t;
+use heapless::Deque;
+use pxros::bindings::{
+    PxAwaitEvents,
+    PxEvents_t,
+    PxGetId,
+    PxMbx_t,
+    PxResetEvents,
+    PxTaskSignalEvents,
+    PxTaskSignalEvents_Hnd,
+    PxTask_t,
+    PxTicks_t,
+};
+use pxros::PxResult;
+use timer::KernelTimer;
+pub use timer::TIMER_EVENT;
 
 use super::events::{Event, Receiver};
+use crate::executor::remote::RemoteWake;
 use crate::executor::{RawExecutor, TaskContext};
-use crate::pxros::executor::local_data::PxrosData;
+use crate::pxros::executor::local_data::{Delivery, PxrosData};
+use crate::pxros::messages::RawMessage;
+use crate::pxros::time::{current_ticks, ticks_reached};
+
+/// Number of task slots tracked by each entry of the waiter index.
+const WAITER_SLOTS: usize = u32::BITS as usize;
+
+/// Number of messages the executor holds back while the inboxes of their
+/// receivers are full.
+pub const HELD_MESSAGES: usize = 4;
+
+/// Event reserved to interrupt a blocked executor, see [PxrosExecutor::with_remote_wake].
+///
+/// Bit 31 is reserved for the logger.
+pub const REMOTE_WAKE_EVENT: u32 = 1 << 30;
+
+/// Events used by the executor itself, in addition to the ones of its tasks.
+const RESERVED_EVENTS: u32 = REMOTE_WAKE_EVENT | TIMER_EVENT;
+
+/// Create a [RemoteWake] for a [PxrosExecutor].
+///
+/// It signals [REMOTE_WAKE_EVENT] to the task running the executor, see
+/// [PxrosExecutor::with_remote_wake].
+pub const fn remote_wake() -> RemoteWake {
+    RemoteWake::new(signal_remote_wake)
+}
+
+/// Interrupt the executor running in the given task, from a task or a handler.
+fn signal_remote_wake(owner: u32) {
+    let task = PxTask_t::from_raw(owner);
+    let events = PxEvents_t(REMOTE_WAKE_EVENT);
+
+    if in_handler() {
+        // Safety: this is the variant for handler context; errors cannot be
+        // reported from handlers.
+        let _ = unsafe { PxTaskSignalEvents_Hnd(task, events) };
+        return;
+    }
+
+    // Safety: called from a task, errors are checked.
+    let result = unsafe { PxTaskSignalEvents(task, events) };
+    if let Err(error) = PxResult::from(result) {
+        defmt::error!("Failed to interrupt the executor of task {}: {}", owner, error);
+    }
+}
+
+/// Returns true if called on handler level rather than from a task.
+///
+/// Handlers run at the priority of their interrupt, tasks at CPU priority 0.
+#[cfg(target_arch = "tricore")]
+fn in_handler() -> bool {
+    extern "C" {
+        fn bsp_uc_core_GetCurrentInterruptPriority() -> u32;
+    }
+
+    // Safety: the BSP function only reads the interrupt control register of
+    // the current core.
+    unsafe { bsp_uc_core_GetCurrentInterruptPriority() != 0 }
+}
+
+/// There are no handlers on other targets, e.g. the host.
+#[cfg(not(target_arch = "tricore"))]
+fn in_handler() -> bool {
+    false
+}
 
 /// Implementation of [RawExecutor] based on Pxros.
 ///
@@ -16,16 +96,223 @@ use crate::pxros::executor::local_data::PxrosData;
 /// will ensure that no unnecessary work is done when no event or message was
 /// received but also return in a timely manner when an event or message has
 /// occurred.
+///
+/// # Waiter index
+/// For every event bit, the executor keeps a mask of the tasks waiting on it;
+/// bit `n` of the mask stands for the tasks at index `n`, `n + 32`, `n + 64`
+/// and so on. The index is updated whenever a task was polled, so a wakeup only
+/// visits the tasks waiting for one of the received events. With up to 32 tasks
+/// the index is exact; beyond that a few tasks sharing a slot are checked in
+/// vain.
+///
+/// # Messages
+/// Received messages are delivered to the inbox of the first task whose
+/// [filter](crate::pxros::messages::MessageFilter) they match, and released if
+/// there is none. Tasks receive messages only while they wait for them or use
+/// an [AsyncMessageReceiver](crate::pxros::messages::AsyncMessageReceiver).
+/// After a message was received, the mailbox is drained without blocking, so a
+/// burst is delivered in one go. If the inboxes of all tasks receiving a message
+/// are full, the executor holds it back and keeps receiving messages for the
+/// other tasks; only once [HELD_MESSAGES] are held back, it stops receiving
+/// until a task made room.
+///
+/// # Timers
+/// All [async timers](crate::pxros::timer) of the tasks share a single one-shot
+/// kernel object and the event [TIMER_EVENT]. Each task registers the earliest
+/// deadline of its timers; the executor keeps an index of the tasks with a
+/// deadline, like for events, and the earliest of all deadlines. The kernel
+/// object is armed for the earliest deadline only, and armed again once that
+/// deadline moved forward or was reached, so the executor is not woken before a
+/// task is due. The kernel object is requested when the first deadline is
+/// registered; if arming fails, the error is logged and the timers are late
+/// until a later attempt succeeds.
+///
+/// # Remote wakeups
+/// By default, a task woken from another PXROS task, e.g. through shared state,
+/// is only polled once the executor receives one of its events or a message.
+/// See [PxrosExecutor::with_remote_wake] to have such wakeups interrupt the
+/// executor right away.
 pub struct PxrosExecutor<E: Event> {
     mailbox: Receiver<E>,
+    /// Task slots waiting for each event bit.
+    event_waiters: [u32; 32],
+    /// Task slots receiving messages.
+    message_waiters: u32,
+    /// Messages held back as the inboxes of their receivers are full.
+    held: Deque<RawMessage, HELD_MESSAGES>,
+    /// Task slots waiting for a deadline.
+    timer_waiters: u32,
+    /// Earliest deadline of the tasks, if any.
+    next_deadline: Option<PxTicks_t>,
+    /// Signals the earliest deadline.
+    timer: KernelTimer,
+    /// Interrupts the blocking wait on wakeups from other tasks.
+    remote: Option<&'static RemoteWake>,
 }
 
 impl<E: Event> PxrosExecutor<E> {
     /// Creates a new executor, using the provided mailbox to provide message
     /// functionalities.
+    ///
+    /// # Panics
+    /// This will panic if the events include [REMOTE_WAKE_EVENT] or [TIMER_EVENT].
     pub fn new(mailbox: PxMbx_t) -> Self {
+        defmt::assert!(
+            E::all().bits() & RESERVED_EVENTS == 0,
+            "The events reserved by the executor cannot be used by tasks"
+        );
+
         Self {
             mailbox: Receiver::new(mailbox, E::all()),
+            event_waiters: [0; 32],
+            message_waiters: 0,
+            held: Deque::new(),
+            timer_waiters: 0,
+            next_deadline: None,
+            timer: KernelTimer::new(),
+            remote: None,
+        }
+    }
+
+    /// Let wakeups from other PXROS tasks, on this or another core, interrupt
+    /// the executor while it blocks; the executor must be run by the calling
+    /// task.
+    ///
+    /// Such a wakeup signals [REMOTE_WAKE_EVENT] to the executor task, at most
+    /// once per blocking wait. Wakers may be invoked from tasks and handlers;
+    /// handlers signal through [PxTaskSignalEvents_Hnd].
+    ///
+    /// ```ignore
+    /// static REMOTE_WAKE: RemoteWake = remote_wake();
+    ///
+    /// let executor = PxrosExecutor::<AsyncEvent>::new(mailbox).with_remote_wake(&REMOTE_WAKE);
+    /// ```
+    pub fn with_remote_wake(mut self, remote: &'static RemoteWake) -> Self {
+        remote.set_owner(PxGetId().as_raw());
+        self.remote = Some(remote);
+        self
+    }
+
+    /// Deliver a message to the inbox of the first task receiving it.
+    ///
+    /// Returns whether a task awaiting the message was marked ready. The message
+    /// is held back if all tasks receiving it have a full inbox, and released if
+    /// no task receives it.
+    fn deliver<C: TaskContext<Self>>(&mut self, tasks: &mut [C], message: RawMessage) -> bool {
+        let mut message = message;
+        let mut full = false;
+
+        for index in Self::candidates(self.message_waiters, tasks.len()) {
+            match tasks[index].local_data().deliver_message(message) {
+                Delivery::Delivered(awaited) => {
+                    if awaited {
+                        tasks[index].mark_ready();
+                    }
+                    return awaited;
+                },
+                Delivery::Full(returned) => {
+                    full = true;
+                    message = returned;
+                },
+                Delivery::Rejected(returned) => message = returned,
+            }
+        }
+
+        if full {
+            defmt::trace!("Inboxes full, holding back message {:?}", message);
+            // Cannot fail, messages are only received while there is room
+            let _ = self.held.push_back(message);
+        } else {
+            defmt::warn!("No tasks receiving message {:?}, discarding", message);
+            if let Err(error) = message.release() {
+                defmt::warn!("Message could not be released: {}", error);
+            }
+        }
+
+        false
+    }
+
+    /// Arm the kernel timer for the earliest deadline, unless it already fires
+    /// in time, and stop it once no deadline remains.
+    ///
+    /// Deadlines reached in the meantime expire right away; returns whether a
+    /// task was marked ready.
+    fn arm_timer<C: TaskContext<Self>>(&mut self, tasks: &mut [C]) -> bool {
+        let Some(deadline) = self.next_deadline else {
+            self.timer.disarm();
+            return false;
+        };
+        if self.timer.armed_for(deadline) {
+            return false;
+        }
+
+        let now = current_ticks();
+        let woken = self.expire_timers(tasks, now);
+        match self.next_deadline {
+            Some(deadline) => {
+                if let Err(error) = self.timer.arm(deadline, now) {
+                    defmt::error!("Failed to arm the timer of the executor: {}", error);
+                }
+            },
+            None => self.timer.disarm(),
+        }
+
+        woken
+    }
+
+    /// Wake the tasks whose deadline was reached at the given tick count.
+    ///
+    /// Returns whether a task was marked ready.
+    fn expire_timers<C: TaskContext<Self>>(&mut self, tasks: &mut [C], now: PxTicks_t) -> bool {
+        match self.next_deadline {
+            Some(earliest) if ticks_reached(earliest, now) => {},
+            _ => return false,
+        }
+
+        let mut woken = false;
+        let mut waiters = 0;
+        let mut next: Option<PxTicks_t> = None;
+
+        for index in Self::candidates(self.timer_waiters, tasks.len()) {
+            let data = tasks[index].local_data();
+            if data.trigger_timer(now) {
+                tasks[index].mark_ready();
+                woken = true;
+            } else if let Some(deadline) = data.timer_deadline() {
+                waiters |= 1 << (index % WAITER_SLOTS);
+                next = match next {
+                    Some(earlier) if ticks_reached(earlier, deadline) => Some(earlier),
+                    _ => Some(deadline),
+                };
+            }
+        }
+
+        self.timer_waiters = waiters;
+        self.next_deadline = next;
+
+        woken
+    }
+
+    /// Iterate over the indices of the tasks in the given waiter slots.
+    fn candidates(slots: u32, task_count: usize) -> impl Iterator<Item = usize> {
+        let mut slots = slots;
+
+        core::iter::from_fn(move || {
+            let slot = slots.trailing_zeros() as usize;
+            slots &= slots.wrapping_sub(1);
+            (slot < WAITER_SLOTS).then_some(slot)
+        })
+        .flat_map(move |slot| (slot..task_count).step_by(WAITER_SLOTS))
+    }
+}
+
+impl<E: Event> Drop for PxrosExecutor<E> {
+    fn drop(&mut self) {
+        // Messages held back are not delivered anymore
+        while let Some(mut message) = self.held.pop_front() {
+            if let Err(error) = message.release() {
+                defmt::warn!("Message could not be released: {}", error);
+            }
         }
     }
 }
@@ -37,20 +324,52 @@ impl<E: Event> RawExecutor for PxrosExecutor<E> {
         loop {
             let mut do_not_continue_loop = !may_block;
 
+            // Retry the messages held back, their receivers may have made room
+            for _ in 0..self.held.len() {
+                if let Some(message) = self.held.pop_front() {
+                    do_not_continue_loop |= self.deliver(tasks, message);
+                }
+            }
+            do_not_continue_loop |= self.arm_timer(tasks);
+
             // Wait for any possible event that this executor might receive
             //
             // If we were *woken* in the global context, reset the events and
             // do not block
             let (events, message) = if do_not_continue_loop {
                 defmt::trace!("Global wake: resetting events");
-                let events = Receiver::reset_events(E::all());
-                let message = self.mailbox.try_message_receive();
+                // Safety: Documentation states no conditions.
+                let events = unsafe { PxResetEvents(PxEvents_t(E::all().bits() | RESERVED_EVENTS)) };
+                let message = (!self.held.is_full())
+                    .then(|| self.mailbox.try_message_receive())
+                    .flatten();
                 (events.0, message)
+            } else if self.held.is_full() {
+                defmt::trace!("Blocking await for events, holding back a message...");
+                // Safety: Documentation states no conditions.
+                let events = unsafe { PxAwaitEvents(PxEvents_t(E::all().bits() | RESERVED_EVENTS)) };
+                (events.0, None)
             } else {
                 defmt::trace!("Blocking await for events or messages...");
-                let (events, message) = self.mailbox.receive();
-                (events.bits(), message)
+                let (events, message) = self.mailbox.receive_raw(PxEvents_t(E::all().bits() | RESERVED_EVENTS));
+                (events.0, message)
             };
+
+            // Tasks marked ready below shall not interrupt us
+            if let Some(remote) = self.remote {
+                remote.disarm();
+            }
+
+            // The woken task was already marked ready by its waker
+            if events & REMOTE_WAKE_EVENT != 0 {
+                defmt::trace!("Remote wakeup");
+                do_not_continue_loop = true;
+            }
+            if events & TIMER_EVENT != 0 {
+                self.timer.fired();
+                do_not_continue_loop |= self.expire_timers(tasks, current_ticks());
+            }
+            let events = events & !RESERVED_EVENTS;
             defmt::trace!(
                 "Status: non-blocking: {}, received: {:b}, total: {:b}",
                 do_not_continue_loop,
@@ -58,46 +377,91 @@ impl<E: Event> RawExecutor for PxrosExecutor<E> {
                 E::all().bits()
             );
 
-            for task in tasks.iter_mut() {
-                // First, we do a consistency check to ensure a task only waits for subset of
-                // supported events; else we panic
-                let _ = E::from_bits(task.local_data().awaiting_events())
-                    .expect("The task is awaiting on unsupported events");
-
-                // If any event from the task was triggered, mark this task ready to perform
-                // work so that the executor will poll it again
-                if task.local_data().trigger_events(events) {
-                    task.mark_ready();
-                    do_not_continue_loop = true;
-                }
-            }
+            // Only visit the tasks waiting for one of the received events; every task
+            // awaiting a received event is triggered, so the index entry is done
+            let mut received = events;
+            while received != 0 {
+                let bit = received.trailing_zeros() as usize;
+                received &= received - 1;
 
-            if let Some(message) = message {
-                let (count, task) = tasks.iter_mut().fold((0, None), |(count, found), task| {
-                    if task.local_data().awaiting_message() {
-                        (count + 1, Some(task))
-                    } else {
-                        (count, found)
+                let waiters = core::mem::take(&mut self.event_waiters[bit]);
+                for index in Self::candidates(waiters, tasks.len()) {
+                    // If any event from the task was triggered, mark this task ready to perform
+                    // work so that the executor will poll it again
+                    if tasks[index].local_data().trigger_events(events) {
+                        tasks[index].mark_ready();
+                        do_not_continue_loop = true;
                     }
-                });
-                defmt::assert!(count <= 1, "Only one task per time can wait for message");
-
-                // Is it found? If not drop the message
-                if let Some(task) = task {
-                    task.local_data().trigger_message(message);
-                    task.mark_ready();
-                    do_not_continue_loop = true;
-                } else {
-                    defmt::warn!("No tasks waiting for message {:?}, discarding", message);
                 }
             }
 
-            if do_not_continue_loop {
+            // Deliver the message and drain the mailbox
+            let mut message = message;
+            while let Some(received) = message {
+                do_not_continue_loop |= self.deliver(tasks, received);
+                message = (!self.held.is_full())
+                    .then(|| self.mailbox.try_message_receive())
+                    .flatten();
+            }
+
+            // Once disarmed, blocking again could miss remote wakeups; the run loop
+            // checks for ready tasks and arms again before calling us
+            if do_not_continue_loop || self.remote.is_some() {
                 break;
             }
         }
     }
 
+    fn polled<C: TaskContext<Self>>(&mut self, index: usize, task: &mut C) {
+        let data = task.local_data();
+        let slot = 1 << (index % WAITER_SLOTS);
+
+        // First, we do a consistency check to ensure a task only waits for subset of
+        // supported events; else we panic
+        let _ = E::from_bits(data.awaiting_events()).expect("The task is awaiting on unsupported events");
+
+        let mut awaiting = data.awaiting_events();
+        while awaiting != 0 {
+            self.event_waiters[awaiting.trailing_zeros() as usize] |= slot;
+            awaiting &= awaiting - 1;
+        }
+
+        if let Some(deadline) = data.timer_deadline() {
+            self.timer_waiters |= slot;
+            self.next_deadline = match self.next_deadline {
+                Some(earlier) if ticks_reached(earlier, deadline) => Some(earlier),
+                _ => Some(deadline),
+            };
+        }
+
+        if data.receives_messages() {
+            self.message_waiters |= slot;
+        }
+
+        // Messages the task does not receive anymore are delivered again, to it
+        // or to another task
+        while !self.held.is_full() {
+            match data.take_rejected() {
+                // Cannot fail, there is room
+                Some(message) => {
+                    let _ = self.held.push_back(message);
+                },
+                None => break,
+            }
+        }
+    }
+
+    fn budget_exhausted<C: TaskContext<Self>>(&mut self, index: usize, exhaustions: u32, _task: &mut C) {
+        // Report every doubling, a task stuck with a full queue would flood the log otherwise
+        if exhaustions.is_power_of_two() {
+            defmt::warn!("Task {} exhausted its poll budget {} times", index, exhaustions);
+        }
+    }
+
+    fn remote_wake(&self) -> Option<&'static RemoteWake> {
+        self.remote
+    }
+
     fn new_context(&self) -> Self::TaskLocalData {
         PxrosData::default()
     }
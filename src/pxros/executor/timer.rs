@@ -0,0 +1,100 @@
+//! Kernel timer shared by all async timers of an executor.
+
+use pxros::bindings::{PxEvents_t, PxOpool_t, PxTicks_t, PxToRelease, PxToRequest, PxToStart, PxToStop, PxTo_t};
+use pxros::PxResult;
+
+use crate::pxros::time::ticks_reached;
+
+/// Event reserved for the kernel timer of the executor.
+pub const TIMER_EVENT: u32 = 1 << 29;
+
+/// One-shot kernel timer signalling [TIMER_EVENT] at the earliest deadline of
+/// the async timers of an executor.
+///
+/// The timeout object is requested on first use and kept while deadlines come
+/// and go; it is only armed again once the earliest deadline moved forward or
+/// the object fired. A timeout object cannot change its duration, so it is
+/// restarted if the next deadline is as far away as the previous one, e.g. for
+/// periodic sleeps, and only requested again otherwise.
+pub(crate) struct KernelTimer {
+    handle: Option<PxTo_t>,
+    /// Duration the current object was requested with.
+    ticks: PxTicks_t,
+    /// Deadline the object fires at, while it is running.
+    armed: Option<PxTicks_t>,
+}
+
+impl KernelTimer {
+    /// Create a timer that is not armed.
+    pub(crate) const fn new() -> Self {
+        Self {
+            handle: None,
+            ticks: PxTicks_t(0),
+            armed: None,
+        }
+    }
+
+    /// Returns true if [TIMER_EVENT] will be signalled at or before the deadline.
+    pub(crate) fn armed_for(&self, deadline: PxTicks_t) -> bool {
+        self.armed.is_some_and(|armed| ticks_reached(armed, deadline))
+    }
+
+    /// Make sure [TIMER_EVENT] is signalled at the deadline.
+    ///
+    /// This may return error if [PxToRequest] or [PxToStart] fails; the timer
+    /// is then not armed and the next call tries again.
+    pub(crate) fn arm(&mut self, deadline: PxTicks_t, now: PxTicks_t) -> PxResult<()> {
+        self.disarm();
+
+        let ticks = PxTicks_t(deadline.0.wrapping_sub(now.0).max(1));
+        let handle = match self.handle {
+            Some(handle) if self.ticks.0 == ticks.0 => handle,
+            _ => {
+                self.release();
+                // Safety: safe to call from any context, errors are checked.
+                let handle = unsafe { PxToRequest(PxOpool_t::default(), ticks, PxEvents_t(TIMER_EVENT)) }.checked()?;
+                self.ticks = ticks;
+                *self.handle.insert(handle)
+            },
+        };
+
+        // Safety: PxTo_t known to be a valid object.
+        PxResult::from(unsafe { PxToStart(handle) })?;
+        self.armed = Some(deadline);
+        Ok(())
+    }
+
+    /// Record that [TIMER_EVENT] was received, so the timer is armed again for
+    /// the next deadline.
+    pub(crate) fn fired(&mut self) {
+        self.armed = None;
+    }
+
+    /// Stop the timer; the object is kept for the next deadline.
+    pub(crate) fn disarm(&mut self) {
+        if let (Some(_), Some(handle)) = (self.armed.take(), self.handle) {
+            // Safety: PxTo_t known to be a valid object; stopping an expired
+            // timeout has no effect, and a stale event is ignored by the
+            // executor.
+            let _ = unsafe { PxToStop(handle) };
+        }
+    }
+
+    /// Release the timeout object, if any.
+    fn release(&mut self) {
+        if let Some(handle) = self.handle.take() {
+            // Safety: we cannot handle failures yet, so we panic in case we fail
+            // at releasing the object.
+            let _ = unsafe { PxToRelease(handle) }
+                .checked()
+                .expect("Failed at releasing PxTo_t");
+        }
+    }
+}
+
+impl Drop for KernelTimer {
+    fn drop(&mut self) {
+        self.disarm();
+        self.release();
+    }
+}
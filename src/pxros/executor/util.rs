@@ -8,6 +8,12 @@
 /// values which will be then collected in a vector and delivered to the
 /// caller
 ///
+/// Tasks woken from other PXROS tasks interrupt the executor right away, see
+/// [PxrosExecutor::with_remote_wake](crate::pxros::executor::PxrosExecutor::with_remote_wake);
+/// the event [REMOTE_WAKE_EVENT](crate::pxros::executor::REMOTE_WAKE_EVENT) is
+/// reserved for this, like [TIMER_EVENT](crate::pxros::executor::TIMER_EVENT)
+/// for the [async timers](crate::pxros::timer).
+///
 /// ## Usage
 ///
 /// ```
@@ -47,15 +53,103 @@
 ///     }
 /// }
 /// ```
+///
+/// ## Static dispatch
+///
+/// Prefixing the mailbox with `static` runs the tasks in a
+/// [StaticExecutor](crate::executor::static_executor::StaticExecutor) instead.
+/// Tasks are then polled through a `match` on their index rather than trait
+/// objects, which allows the compiler to inline their poll functions into the
+/// executor loop. Usage and results are the same:
+///
+/// ```ignore
+/// let result = pxros_run!(static mailbox, AsyncEvent, PxResult<i64>, foo(10), bar());
+/// ```
+///
+/// ## Priorities
+///
+/// A task may be followed by `=>` and its [Priority](crate::executor::executor::Priority);
+/// tasks without one run with `Priority::Normal`. Whenever tasks of different
+/// priorities are ready, the higher one is polled first, so a critical task is
+/// delayed by at most one poll of another task after being woken:
+///
+/// ```ignore
+/// let result = pxros_run!(mailbox, AsyncEvent, PxResult<i64>, foo(10) => Priority::Critical, bar());
+/// ```
+///
+/// ## Task pools
+///
+/// [Task pools](crate::executor::pool::TaskPool) to spawn futures into at
+/// runtime are listed after the tasks, separated by a semicolon, together with
+/// their size. Their slots come after the tasks in the results, and are always
+/// empty:
+///
+/// ```ignore
+/// static HANDLERS: TaskPool<Handler, PxrosExecutor<AsyncEvent>, 4> = TaskPool::new();
+///
+/// let result = pxros_run!(mailbox, AsyncEvent, PxResult<()>, server(HANDLERS.spawner()); HANDLERS: 4);
+/// ```
 #[macro_export]
 macro_rules! pxros_run {
-    ($mailbox:ident, $event:ty, $ret:ty, $($future:expr),* $(,)?) => {{
-        use $crate::executor::executor::Executor;
-        use $crate::pxros::executor::PxrosExecutor;
+    (@priority) => {
+        Priority::Normal
+    };
+    (@priority $priority:expr) => {
+        $priority
+    };
+    (
+        static $mailbox:ident, $event:ty, $ret:ty, $($future:expr $(=> $priority:expr)?),* $(,)?
+        $(; $($pool:path: $size:expr),+ $(,)?)?
+    ) => {{
+        use $crate::executor::executor::Priority;
+        use $crate::executor::static_executor::StaticExecutor;
+        use $crate::executor::remote::RemoteWake;
+        use $crate::pxros::executor::{remote_wake, PxrosExecutor};
+        use pxros::PxResult;
+
+        static REMOTE_WAKE: RemoteWake = remote_wake();
+        let executor: StaticExecutor<PxrosExecutor<$event>, $ret, _, { ${count(future)} $($(+ $size)+)? }> =
+            StaticExecutor::new(PxrosExecutor::new($mailbox).with_remote_wake(&REMOTE_WAKE));
+
+        $(
+            let executor = {
+                use $crate::StaticCell;
+                use $crate::executor::task::TaskStorage;
+
+                type F = impl ::core::future::Future<Output = $ret>;
+                static TASK: StaticCell<TaskStorage<F, PxrosExecutor<$event>>> = StaticCell::new();
+
+                let task = TASK.init(TaskStorage::new($future));
+                executor.with_task_priority(task, $crate::pxros_run!(@priority $($priority)?))
+            };
+        )*
+        $($(
+            let executor = executor.with_pool::<_, { $size }>(&$pool);
+        )+)?
+
+        executor.run_with(|tasks, index| {
+            use $crate::executor::static_executor::TaskList;
+
+            match index {
+                $(${ignore(future)} ${index()} => tasks.poll_task::<{ ${index()} }>(),)*
+                // Slots of the pools
+                index => tasks.poll(index),
+            }
+        })
+    }};
+    (
+        $mailbox:ident, $event:ty, $ret:ty, $($future:expr $(=> $priority:expr)?),* $(,)?
+        $(; $($pool:path: $size:expr),+ $(,)?)?
+    ) => {{
+        use $crate::executor::executor::{Executor, Priority};
+        use $crate::executor::remote::RemoteWake;
+        use $crate::pxros::executor::{remote_wake, PxrosExecutor};
         use pxros::PxResult;
 
-        type SpecificExecutor = Executor<'static, PxrosExecutor<$event>, $ret, ${count(future)}>;
-        let mut executor: SpecificExecutor = Executor::new(PxrosExecutor::new($mailbox));
+        type SpecificExecutor = Executor<'static, PxrosExecutor<$event>, $ret, { ${count(future)} $($(+ $size)+)? }>;
+        static REMOTE_WAKE: RemoteWake = remote_wake();
+        let mut executor: SpecificExecutor =
+            Executor::new(PxrosExecutor::new($mailbox).with_remote_wake(&REMOTE_WAKE));
 
         $(
             {
@@ -66,9 +160,12 @@ macro_rules! pxros_run {
                 static TASK: StaticCell<TaskStorage<F, PxrosExecutor<$event>>> = StaticCell::new();
 
                 let task = TASK.init(TaskStorage::new($future));
-                executor.add(task);
+                executor.add_with_priority(task, $crate::pxros_run!(@priority $($priority)?));
             }
         )*
+        $($(
+            executor.add_pool::<_, { $size }>(&$pool);
+        )+)?
 
         executor.run()
     }};
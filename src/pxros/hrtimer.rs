@@ -0,0 +1,121 @@
+//! High resolution one-shot timers.
+//!
+//! These timers use the second compare channel of the System Timer of the
+//! current core, see `HrTimerStart` in the BSP, so their deadlines are not
+//! rounded to the PXROS tick: they can be tens of microseconds apart. On expiry
+//! the compare interrupt signals an [Event] to the task that started the timer.
+//!
+//! For timers with tick resolution, refer to [crate::pxros::timer] and
+//! [crate::pxros::ticker].
+
+use core::future::Future;
+use core::pin::Pin;
+use core::task::{Context, Poll};
+use core::time::Duration;
+
+use futures::{pin_mut, FutureExt};
+use pxros::bindings::{PxError_t, PxEvents_t, PxGetId, PxTask_t};
+use pxros::PxResult;
+
+use super::events::{Event, Receiver};
+use super::executor::local_data::wait_for_event;
+use super::time::Instant;
+
+extern "C" {
+    fn HrTimerStart(deadline: u64, task: PxTask_t, events: PxEvents_t) -> u32;
+    fn HrTimerCancel(id: u32);
+}
+
+/// A one-shot timer that signals an [Event] at an [Instant].
+///
+/// Dropping the timer cancels it; if it expired already, its event may still
+/// be pending.
+///
+/// ## Note
+/// Each core serves a limited number of pending timers, see `HRTIMER_QUEUE_SIZE`
+/// in the BSP.
+pub struct HrTimer<E: Event> {
+    event: E,
+    id: u32,
+}
+
+impl<E: Event> HrTimer<E> {
+    /// Starts a timer that triggers the event at the deadline, or right away if
+    /// it passed already.
+    ///
+    /// This returns [PxError_t::PXERR_GLOBAL_OBJLIST_EMPTY] if too many timers
+    /// are pending on this core.
+    pub fn at(event: E, deadline: Instant) -> PxResult<Self> {
+        // Safety: the BSP function has no conditions, it accesses the timer queue
+        // on handler level only.
+        let id = unsafe { HrTimerStart(deadline.ticks(), PxGetId(), PxEvents_t(event.bits())) };
+
+        match id {
+            0 => Err(PxError_t::PXERR_GLOBAL_OBJLIST_EMPTY),
+            id => Ok(Self { event, id }),
+        }
+    }
+
+    /// Starts a timer that triggers the event after the given duration.
+    ///
+    /// See [HrTimer::at] for details; this reads the System Timer, which needs
+    /// the access rights documented on [Instant].
+    pub fn after(event: E, duration: Duration) -> PxResult<Self> {
+        Self::at(event, Instant::now() + duration)
+    }
+
+    /// Waits for the timer to expire in blocking manner.
+    pub fn wait(self) {
+        let evt = Receiver::await_events(self.event);
+
+        if evt.0 != self.event.bits() {
+            defmt::panic!("Received unexpected event {}, expected {}", evt.0, self.event.bits());
+        }
+    }
+
+    /// Returns the event owned by the timer.
+    pub const fn event(&self) -> E {
+        self.event
+    }
+}
+
+impl<E: Event> Drop for HrTimer<E> {
+    fn drop(&mut self) {
+        // Safety: cancelling a timer that expired already has no effect.
+        unsafe { HrTimerCancel(self.id) }
+    }
+}
+
+/// Async variant of [HrTimer].
+///
+/// This timer implements [Future] for async usage.
+pub struct AsyncHrTimer<E: Event> {
+    timer: HrTimer<E>,
+}
+
+impl<E: Event + Unpin> AsyncHrTimer<E> {
+    /// Start a timer that triggers the event at the deadline.
+    ///
+    /// See [HrTimer::at] for details.
+    pub fn at(event: E, deadline: Instant) -> PxResult<Self> {
+        HrTimer::at(event, deadline).map(|timer| Self { timer })
+    }
+
+    /// Start a timer that triggers the event after the given duration.
+    ///
+    /// See [HrTimer::at] for details.
+    pub fn after(event: E, duration: Duration) -> PxResult<Self> {
+        HrTimer::after(event, duration).map(|timer| Self { timer })
+    }
+}
+
+impl<E: Event + Unpin> Future for AsyncHrTimer<E> {
+    type Output = ();
+
+    fn poll(self: Pin<&mut Self>, context: &mut Context<'_>) -> Poll<Self::Output> {
+        let future = wait_for_event(self.timer.event());
+        pin_mut!(future);
+
+        future.poll_unpin(context)
+    }
+}
@@ -0,0 +1,158 @@
+//! Bridge from hardware interrupts to async tasks.
+
+use core::pin::Pin;
+use core::sync::atomic::{AtomicU32, Ordering};
+use core::task::{Context, Poll};
+
+use futures::{pin_mut, Future, Stream};
+use pxros::bindings::{
+    PxArg_t,
+    PxEvents_t,
+    PxGetId,
+    PxIntInstallFastContextHandler,
+    PxTaskSignalEvents_Hnd,
+    PxTask_t,
+    PxUInt_t,
+};
+use pxros::PxResult;
+
+use super::events::Event;
+use super::executor::local_data::wait_for_event;
+use crate::executor::budget::poll_budgeted;
+
+/// Interrupts latched since the last time they were taken.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, defmt::Format)]
+pub struct Interrupts {
+    /// Number of interrupts.
+    pub count: u32,
+    /// Payload read by the last interrupt, see [AsyncInterrupt::with_payload].
+    pub payload: u32,
+}
+
+/// An interrupt that async tasks can wait for.
+///
+/// [AsyncInterrupt::install] installs a fast context handler for the interrupt.
+/// On every interrupt, the handler latches a count and optionally a payload
+/// read from the peripheral, and signals an [Event] to the PXROS task running
+/// the executor. A task waiting in [AsyncInterrupt::wait] then takes all
+/// interrupts latched since its last wait; interrupts occurring while no task
+/// waits are not lost, but counted.
+///
+/// ```ignore
+/// static UART_RX: AsyncInterrupt<AsyncEvent> = AsyncInterrupt::new(AsyncEvent::UART_RX);
+///
+/// async fn uart() -> PxResult<()> {
+///     UART_RX.install(UART_RX_PRIORITY)?;
+///     loop {
+///         let interrupts = UART_RX.wait().await;
+///         // ...
+///     }
+/// }
+/// ```
+///
+/// ## Note
+/// The installing task needs the [PxAccess::INSTALL_HANDLERS](crate::pxros::task::PxAccess::INSTALL_HANDLERS)
+/// right.
+pub struct AsyncInterrupt<E: Event> {
+    event: E,
+    /// Reads the payload in the handler.
+    read: Option<fn() -> u32>,
+    /// Interrupts since the last [AsyncInterrupt::take].
+    count: AtomicU32,
+    /// Payload read by the last interrupt.
+    payload: AtomicU32,
+    /// Task to signal the event to, set on installation.
+    task: AtomicU32,
+}
+
+impl<E: Event> AsyncInterrupt<E> {
+    /// Create an interrupt that signals the given event.
+    pub const fn new(event: E) -> Self {
+        AsyncInterrupt {
+            event,
+            read: None,
+            count: AtomicU32::new(0),
+            payload: AtomicU32::new(0),
+            task: AtomicU32::new(0),
+        }
+    }
+
+    /// Create an interrupt that signals the given event and latches the value
+    /// returned by `read`.
+    ///
+    /// `read` runs in the interrupt handler, e.g. to read a status register
+    /// before it is overwritten; it shall be short and must not call PXROS.
+    pub const fn with_payload(event: E, read: fn() -> u32) -> Self {
+        AsyncInterrupt {
+            read: Some(read),
+            ..Self::new(event)
+        }
+    }
+
+    /// Install the handler for the interrupt with the given priority.
+    ///
+    /// The event is signalled to the calling task, which must be the one running
+    /// the executor of the waiting task.
+    ///
+    /// See [PxIntInstallFastContextHandler] for details and failure reasons.
+    pub fn install(&'static self, priority: PxUInt_t) -> PxResult<()> {
+        self.task.store(PxGetId().as_raw(), Ordering::Relaxed);
+
+        let argument = PxArg_t(self as *const Self as i32);
+        // Safety: the handler only accesses this static instance through the argument.
+        let result = unsafe { PxIntInstallFastContextHandler(priority, Some(Self::handler), argument) };
+        PxResult::from(result)
+    }
+
+    /// Fast context handler; latches the interrupt and signals the event.
+    unsafe extern "C" fn handler(argument: PxArg_t) {
+        // Safety: the argument was created from a static reference in `install`.
+        let interrupt = unsafe { &*(argument.0 as *const Self) };
+
+        if let Some(read) = interrupt.read {
+            interrupt.payload.store(read(), Ordering::Relaxed);
+        }
+        interrupt.count.fetch_add(1, Ordering::Release);
+
+        let task = PxTask_t::from_raw(interrupt.task.load(Ordering::Relaxed));
+        // Safety: this is the variant for handler context; errors cannot be
+        // reported from here.
+        let _ = unsafe { PxTaskSignalEvents_Hnd(task, PxEvents_t(interrupt.event.bits())) };
+    }
+
+    /// Take the interrupts latched so far, if any.
+    pub fn take(&self) -> Option<Interrupts> {
+        let count = self.count.swap(0, Ordering::Acquire);
+
+        (count != 0).then(|| Interrupts {
+            count,
+            payload: self.payload.load(Ordering::Relaxed),
+        })
+    }
+
+    /// Asynchronously wait for interrupts, returning the ones latched since the
+    /// last wait.
+    pub async fn wait(&self) -> Interrupts {
+        loop {
+            if let Some(interrupts) = self.take() {
+                return interrupts;
+            }
+
+            // The event may stem from interrupts already taken; check again
+            wait_for_event(self.event).await;
+        }
+    }
+}
+
+impl<E: Event> Stream for &'static AsyncInterrupt<E> {
+    type Item = Interrupts;
+
+    fn poll_next(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<Option<Self::Item>> {
+        poll_budgeted(cx, |cx| {
+            let future = self.wait();
+            pin_mut!(future);
+
+            future.poll(cx).map(Some)
+        })
+    }
+}
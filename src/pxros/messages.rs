@@ -1,15 +1,23 @@
 //! Abstraction over Pxros message API.
 
+use core::future::poll_fn;
+use core::mem::{align_of, size_of, ManuallyDrop};
+use core::ops::{Deref, DerefMut};
 use core::pin::Pin;
+use core::ptr::NonNull;
 use core::slice;
 use core::task::{Context, Poll};
+use core::time::Duration;
 
-use futures::{pin_mut, Future, Stream};
+use futures::Stream;
+use heapless::Deque;
 use pxros::bindings::{
     PxError_t,
     PxEvents_t,
     PxGetError,
     PxHandle,
+    PxMbxRelease,
+    PxMbxRequest,
     PxMbx_t,
     PxMc_t,
     PxMsgAwaitRel,
@@ -46,10 +54,44 @@ use pxros::bindings::{
 };
 use pxros::PxResult;
 
-use super::executor::local_data::wait_for_message;
+use super::executor::local_data::MessageRegistration;
+use super::timer::sleep;
+use crate::executor::budget::poll_budgeted;
 use crate::pxros::events::Event;
 use crate::pxros::name_server::{NameServer, TaskName};
 
+/// Selects the messages a task receives from the mailbox of its executor.
+///
+/// See [AsyncMessageReceiver::with_filter].
+#[derive(Debug, Clone, Copy)]
+pub enum MessageFilter {
+    /// Any message.
+    Any,
+    /// Messages whose metadata equals the tag.
+    Metadata(u32),
+    /// Messages whose metadata equals the value in the bits of the mask.
+    MetadataMasked { mask: u32, value: u32 },
+    /// Messages sent by the task.
+    Sender(PxTask_t),
+    /// Messages the classifier returns true for.
+    Custom(fn(&RawMessage) -> bool),
+}
+
+impl MessageFilter {
+    /// Check whether the message passes this filter.
+    pub fn matches(&self, message: &RawMessage) -> bool {
+        match self {
+            MessageFilter::Any => true,
+            MessageFilter::Metadata(tag) => message.metadata().is_ok_and(|metadata| metadata.0 == *tag),
+            MessageFilter::MetadataMasked { mask, value } => {
+                message.metadata().is_ok_and(|metadata| metadata.0 & mask == *value)
+            },
+            MessageFilter::Sender(task) => message.sender().is_ok_and(|sender| sender == *task),
+            MessageFilter::Custom(classifier) => classifier(message),
+        }
+    }
+}
+
 /// Wraps [`PxMsgEvent_t`] in a Rust enum for requesting or receiving a message with events.
 #[derive(Debug, defmt::Format)]
 pub enum NewMessageEvents {
@@ -111,6 +153,48 @@ impl TryFrom<PxMsgEvent_t> for ReleaseWithEvent {
     }
 }
 
+/// Interval after which asynchronous requests and releases are checked again
+/// for the first time.
+///
+/// The kernel only notifies about free memory and released messages to tasks
+/// blocking on them, e.g. through [`PxMsgRequest_EvWait`], which would block all
+/// tasks of the executor. The futures waiting instead check again on the
+/// [TIMER_EVENT](super::executor::TIMER_EVENT) reserved by the executor, see
+/// [sleep]; its kernel object is kept once requested, and only exchanged for
+/// another one after it was released, so retrying does not need a free kernel
+/// object while the object pool is exhausted. The futures thus panic if polled
+/// outside the [PxrosExecutor](super::executor::PxrosExecutor).
+///
+/// The interval doubles with every further check, up to [MAX_RETRY_INTERVAL],
+/// so a long wait does not wake the executor every tick.
+pub const RETRY_INTERVAL: Duration = Duration::from_millis(1);
+
+/// Longest interval in which asynchronous requests and releases are checked
+/// again, see [RETRY_INTERVAL].
+pub const MAX_RETRY_INTERVAL: Duration = Duration::from_millis(32);
+
+/// Call the function until it returns anything but an error to retry on,
+/// checking again with exponential backoff, see [RETRY_INTERVAL].
+async fn retry<T>(mut attempt: impl FnMut() -> PxResult<T>, retry_on: impl Fn(PxError_t) -> bool) -> PxResult<T> {
+    let mut interval = RETRY_INTERVAL;
+
+    loop {
+        match attempt() {
+            Err(error) if retry_on(error) => {
+                sleep(interval).await;
+                interval = (interval * 2).min(MAX_RETRY_INTERVAL);
+            },
+            result => return result,
+        }
+    }
+}
+
+/// Returns true if the error signals that the memory class or object pool is
+/// exhausted, so a blocking request would wait.
+fn is_exhausted(error: PxError_t) -> bool {
+    matches!(error, PxError_t::PXERR_MSG_NOMEM | PxError_t::PXERR_GLOBAL_OBJLIST_EMPTY)
+}
+
 /// Wraps a [PxMsg_t] to provide checked access to message methods.
 #[derive(Debug, Eq, PartialEq)]
 pub struct RawMessage {
@@ -125,6 +209,17 @@ impl RawMessage {
         PxMsgAwaitRel(self.message_handle).checked().map(|_| ())
     }
 
+    /// Asynchronously awaits the release of a marked message.
+    ///
+    /// Unlike [RawMessage::await_release], this does not block the executor:
+    /// the release is checked without blocking, see [`PxMsgAwaitRel_NoWait`],
+    /// and again with backoff while other tasks run, see [RETRY_INTERVAL].
+    pub async fn await_release_async(&self) -> PxResult<()> {
+        retry(|| PxMsgAwaitRel_NoWait(self.message_handle).checked(), |error| error == PxError_t::PXERR_MSG_NOMSG)
+            .await
+            .map(|_| ())
+    }
+
     /// Awaits the release of a marked message or returns if an event occurs.
     ///
     /// See [`PxMsgAwaitRel_EvWait`] for details.
@@ -236,6 +331,18 @@ impl RawMessage {
         Ok(Self { message_handle })
     }
 
+    /// Asynchronously requests a message, waiting while the memory class or
+    /// object pool is exhausted.
+    ///
+    /// Unlike [RawMessage::request], this does not block the executor: the
+    /// request is made without blocking, see [`PxMsgRequest_NoWait`], and
+    /// retried with backoff while other tasks run, see [RETRY_INTERVAL].
+    /// Producers are thus slowed down to the pace at which consumers release
+    /// messages.
+    pub async fn request_async(message_size: u32, memory_class: PxMc_t, object_pool: PxOpool_t) -> PxResult<Self> {
+        retry(|| Self::request_no_wait(message_size, memory_class, object_pool), is_exhausted).await
+    }
+
     /// Requests a message or returns if an event occurs.
     ///
     /// See [`PxMsgRequest_EvWait`] for details.
@@ -356,11 +463,377 @@ impl defmt::Format for RawMessage {
     }
 }
 
+/// Types that can be carried by a [Message].
+///
+/// # Safety
+/// Any bit pattern, including all zeros, must be a valid value of the type, and
+/// the type must not contain references or pointers: the value is read from
+/// memory written by another task, possibly on another core. `#[repr(C)]`
+/// structs of integers and arrays are typical implementors.
+pub unsafe trait Plain: Copy + 'static {}
+
+macro_rules! impl_plain {
+    ($($ty:ty),*) => {
+        $(
+            // Safety: any bit pattern is a valid value of the primitive.
+            unsafe impl Plain for $ty {}
+        )*
+    };
+}
+
+impl_plain!(u8, u16, u32, u64, usize, i8, i16, i32, i64, isize, f32, f64);
+
+// Safety: any bit pattern is valid for the array if it is for the elements.
+unsafe impl<T: Plain, const N: usize> Plain for [T; N] {}
+
+/// A message whose data is a value of a [Plain] type.
+///
+/// The value lives in the message buffer: senders construct it there through
+/// [Message::request_with] or [DerefMut], and receivers borrow it through
+/// [Deref], so it is not copied on either side. The location of the data is
+/// queried from the kernel once, when the message is created.
+///
+/// ```ignore
+/// #[derive(Clone, Copy)]
+/// #[repr(C)]
+/// struct Sample {
+///     channel: u32,
+///     value: i32,
+/// }
+///
+/// // Safety: the struct consists of integers only.
+/// unsafe impl Plain for Sample {}
+///
+/// let message = sender.message_with(|sample: &mut Sample| sample.value = read_adc())?;
+/// sender.send_message(message)?;
+///
+/// // On the receiving side
+/// if let Ok(sample) = Message::<Sample>::try_from(receiver.wait().await) {
+///     defmt::info!("Channel {}: {}", sample.channel, sample.value);
+/// }
+/// ```
+///
+/// The message is released once dropped, unless it was sent.
+pub struct Message<T: Plain> {
+    raw: RawMessage,
+    data: NonNull<T>,
+}
+
+impl<T: Plain> Message<T> {
+    /// Requests a message holding a zeroed value.
+    ///
+    /// See [RawMessage::request] for details.
+    pub fn request(memory_class: PxMc_t, object_pool: PxOpool_t) -> PxResult<Self> {
+        let raw = RawMessage::request(size_of::<T>() as u32, memory_class, object_pool)?;
+        Self::zeroed(raw)
+    }
+
+    /// Requests a message and initializes its value in place.
+    ///
+    /// The value is zeroed before `init` is called on it.
+    pub fn request_with(memory_class: PxMc_t, object_pool: PxOpool_t, init: impl FnOnce(&mut T)) -> PxResult<Self> {
+        let mut message = Self::request(memory_class, object_pool)?;
+        init(&mut message);
+        Ok(message)
+    }
+
+    /// Takes over a message if its data holds a value of the type.
+    ///
+    /// Returns the message back if its data is too short or not aligned for
+    /// the type.
+    pub fn from_raw(raw: RawMessage) -> Result<Self, RawMessage> {
+        // Safety:
+        // PXROS methods check their parameters; a null pointer signals an error.
+        let PxMsgData_t(data_pointer) = unsafe { PxMsgGetData(raw.message_handle) };
+        let Some(data) = NonNull::new(data_pointer as *mut T) else {
+            return Err(raw);
+        };
+
+        let fits = raw.size().is_ok_and(|size| size as usize >= size_of::<T>());
+        if !fits || data.as_ptr().align_offset(align_of::<T>()) != 0 {
+            return Err(raw);
+        }
+        Ok(Self { raw, data })
+    }
+
+    /// Takes over a message, zeroing the value in its data.
+    ///
+    /// The message is released if its data is too short or not aligned for the
+    /// type.
+    fn zeroed(raw: RawMessage) -> PxResult<Self> {
+        let message = Self::from_raw(raw).map_err(|mut raw| {
+            if let Err(error) = raw.release() {
+                defmt::warn!("Message could not be released: {}", error);
+            }
+            PxError_t::PXERR_REQUEST_FAILED
+        })?;
+
+        // Safety: the buffer is valid for writes of the type; any bit pattern,
+        // including zeros, is a valid value of it.
+        unsafe { message.data.as_ptr().write_bytes(0, 1) };
+        Ok(message)
+    }
+
+    /// Gives up the typed access, returning the message without releasing it.
+    pub fn into_raw(self) -> RawMessage {
+        let message = ManuallyDrop::new(self);
+        // Safety: the message is not dropped, so the handle is moved out once.
+        unsafe { core::ptr::read(&message.raw) }
+    }
+
+    /// Returns the underlying message, e.g. to query its sender.
+    pub const fn raw(&self) -> &RawMessage {
+        &self.raw
+    }
+
+    /// Sets the metadata.
+    ///
+    /// See [RawMessage::set_metadata] for details.
+    pub fn set_metadata(&mut self, metadata: PxMsgMetadata_t) -> PxResult<()> {
+        self.raw.set_metadata(metadata)
+    }
+
+    /// Sends the message, releasing it if that fails.
+    ///
+    /// See [RawMessage::send] for details.
+    pub fn send(self, mailbox: PxMbx_t) -> PxResult<()> {
+        let mut raw = self.into_raw();
+        let result = raw.send(mailbox);
+        if result.is_err() {
+            if let Err(error) = raw.release() {
+                defmt::warn!("Message could not be released: {}", error);
+            }
+        }
+        result
+    }
+}
+
+impl<T: Plain> TryFrom<RawMessage> for Message<T> {
+    type Error = RawMessage;
+
+    fn try_from(raw: RawMessage) -> Result<Self, Self::Error> {
+        Self::from_raw(raw)
+    }
+}
+
+impl<T: Plain> Deref for Message<T> {
+    type Target = T;
+
+    fn deref(&self) -> &T {
+        // Safety: the pointer was checked for size and alignment on creation and
+        // the buffer is owned by this message; any bit pattern is a valid value.
+        unsafe { self.data.as_ref() }
+    }
+}
+
+impl<T: Plain> DerefMut for Message<T> {
+    fn deref_mut(&mut self) -> &mut T {
+        // Safety: see Deref, access is unique through the mutable reference.
+        unsafe { self.data.as_mut() }
+    }
+}
+
+impl<T: Plain> Drop for Message<T> {
+    fn drop(&mut self) {
+        if let Err(error) = self.raw.release() {
+            defmt::warn!("Message could not be released: {}", error);
+        }
+    }
+}
+
+/// A fixed set of `N` messages of `SIZE` bytes, recycled instead of requested
+/// and released on every send.
+///
+/// The messages are requested once, on creation, and the mailbox of the pool is
+/// installed as their release mailbox: releasing a message taken from the pool,
+/// by any task, returns it to the pool instead of its memory class. Steady-state
+/// messaging thus neither allocates nor fragments the memory class.
+///
+/// ```ignore
+/// let mut pool = MessagePool::<4, 64>::new(PxMc_t::default(), PxOpool_t::default())?;
+///
+/// loop {
+///     let message = pool.take_message_with(|sample: &mut Sample| sample.value = read_adc())?;
+///     sender.send_message(message)?;
+///     // ...
+/// }
+/// ```
+///
+/// The number of messages still free is tracked, see
+/// [MessagePool::low_water_mark], to size `N` for the actual load.
+///
+/// ## Note
+/// The messages are not given back to the memory class; the pool is meant to
+/// live as long as the task.
+pub struct MessagePool<const N: usize, const SIZE: usize> {
+    /// Release mailbox of the messages.
+    mailbox: PxMbx_t,
+    /// Messages collected from the mailbox, free to be taken.
+    free: Deque<RawMessage, N>,
+    /// Fewest free messages when a message was taken.
+    low_water_mark: usize,
+    /// Times a message was to be taken while none was free.
+    exhausted: u32,
+}
+
+impl<const N: usize, const SIZE: usize> MessagePool<N, SIZE> {
+    /// Request the messages of the pool from the memory class and a release
+    /// mailbox from the object pool.
+    ///
+    /// See [PxMbxRequest], [RawMessage::request] and
+    /// [RawMessage::install_release_mailbox] for details and failure reasons;
+    /// on failure, the messages and the mailbox requested so far are released.
+    pub fn new(memory_class: PxMc_t, object_pool: PxOpool_t) -> PxResult<Self> {
+        // Safety: safe to call from any context, errors are checked.
+        let mailbox = unsafe { PxMbxRequest(object_pool) }.checked()?;
+        let mut pool = Self {
+            mailbox,
+            free: Deque::new(),
+            low_water_mark: N,
+            exhausted: 0,
+        };
+
+        if let Err(error) = pool.fill(memory_class, object_pool) {
+            pool.discard();
+            return Err(error);
+        }
+
+        Ok(pool)
+    }
+
+    /// Request the messages of the pool and install its mailbox as their
+    /// release mailbox.
+    ///
+    /// All messages are requested first, so a failed request leaves no message
+    /// bound to the mailbox.
+    fn fill(&mut self, memory_class: PxMc_t, object_pool: PxOpool_t) -> PxResult<()> {
+        while !self.free.is_full() {
+            let message = RawMessage::request(SIZE as u32, memory_class, object_pool)?;
+            // Checked for room above
+            let _ = self.free.push_back(message);
+        }
+
+        for message in self.free.iter_mut() {
+            message.install_release_mailbox(self.mailbox)?;
+        }
+        Ok(())
+    }
+
+    /// Release the messages and the mailbox of a pool that failed to be
+    /// created.
+    ///
+    /// Messages already bound to the mailbox are released into it, and with it.
+    fn discard(&mut self) {
+        while let Some(mut message) = self.free.pop_front() {
+            if let Err(error) = message.release() {
+                defmt::warn!("Message could not be released: {}", error);
+            }
+        }
+
+        // Safety: PxMbx_t known to be a valid object, errors are checked.
+        if let Err(error) = unsafe { PxMbxRelease(self.mailbox) }.checked() {
+            defmt::warn!("Mailbox could not be released: {}", error);
+        }
+    }
+
+    /// Take a free message without blocking.
+    ///
+    /// Returns [PxError_t::PXERR_MSG_NOMSG] if all messages are in use.
+    pub fn take(&mut self) -> PxResult<RawMessage> {
+        self.collect()?;
+
+        match self.free.pop_front() {
+            Some(message) => {
+                self.low_water_mark = self.low_water_mark.min(self.free.len());
+                Ok(message)
+            },
+            None => {
+                self.low_water_mark = 0;
+                self.exhausted = self.exhausted.saturating_add(1);
+                Err(PxError_t::PXERR_MSG_NOMSG)
+            },
+        }
+    }
+
+    /// Take a free message, waiting in blocking manner for one to be released
+    /// if all are in use.
+    ///
+    /// See [RawMessage::receive] for details.
+    pub fn take_wait(&mut self) -> PxResult<RawMessage> {
+        match self.take() {
+            Err(PxError_t::PXERR_MSG_NOMSG) => RawMessage::receive(self.mailbox),
+            result => result,
+        }
+    }
+
+    /// Asynchronously take a free message, waiting for one to be released if
+    /// all are in use.
+    ///
+    /// The release mailbox is checked again with backoff while other tasks run,
+    /// see [RETRY_INTERVAL]; to wait for a release in blocking manner along with
+    /// other sources, see [MessagePool::release_mailbox].
+    pub async fn take_async(&mut self) -> PxResult<RawMessage> {
+        retry(|| self.take(), |error| error == PxError_t::PXERR_MSG_NOMSG).await
+    }
+
+    /// Take a free message without blocking and initialize a typed value in
+    /// place, see [Message::request_with].
+    ///
+    /// # Panics
+    /// This will panic if the type does not fit into `SIZE` bytes.
+    pub fn take_message_with<T: Plain>(&mut self, init: impl FnOnce(&mut T)) -> PxResult<Message<T>> {
+        assert!(size_of::<T>() <= SIZE, "Type does not fit into the messages of the pool");
+
+        let mut message = Message::zeroed(self.take()?)?;
+        init(&mut message);
+        Ok(message)
+    }
+
+    /// Returns the number of free messages as of the last take.
+    pub fn available(&self) -> usize {
+        self.free.len()
+    }
+
+    /// Returns the fewest free messages left by a take since creation.
+    ///
+    /// Zero means that the pool ran out of messages at least once, see
+    /// [MessagePool::exhausted].
+    pub const fn low_water_mark(&self) -> usize {
+        self.low_water_mark
+    }
+
+    /// Returns how often a message was to be taken while none was free.
+    pub const fn exhausted(&self) -> u32 {
+        self.exhausted
+    }
+
+    /// Returns the release mailbox of the messages, e.g. to wait for one in
+    /// combination with other sources.
+    pub const fn release_mailbox(&self) -> PxMbx_t {
+        self.mailbox
+    }
+
+    /// Collect the messages released to the mailbox since the last call.
+    fn collect(&mut self) -> PxResult<()> {
+        while !self.free.is_full() {
+            match RawMessage::receive_no_wait(self.mailbox) {
+                Ok(message) => {
+                    // Checked for room above
+                    let _ = self.free.push_back(message);
+                },
+                Err(PxError_t::PXERR_MSG_NOMSG) => break,
+                Err(error) => return Err(error),
+            }
+        }
+        Ok(())
+    }
+}
+
 /// Allows to send *messages* to other tasks in non-blocking manner.
 ///
 /// ## Note
-/// At the moment this only allows for sending raw bytes. Future PRs will
-/// provide better usage through serializers, sinks, iterators, etc.
+/// This allows for sending raw bytes, which are copied into the message, and
+/// typed [Message]s, which are constructed in place.
 pub struct MailSender {
     mailbox: PxMbx_t,
     class: PxMc_t,
@@ -405,23 +878,61 @@ impl MailSender {
         // Send the message and clear any memory
         message.send(self.mailbox)
     }
+
+    /// Requests a [Message] from the memory class and object pool of this
+    /// sender and initializes its value in place.
+    ///
+    /// See [Message::request_with] for details.
+    pub fn message_with<T: Plain>(&self, init: impl FnOnce(&mut T)) -> PxResult<Message<T>> {
+        Message::request_with(self.class, self.pool, init)
+    }
+
+    /// Send a typed message without copying its value.
+    ///
+    /// See [Message::send] for details.
+    pub fn send_message<T: Plain>(&mut self, message: Message<T>) -> PxResult<()> {
+        message.send(self.mailbox)
+    }
 }
 
 /// Async variant of [super::events::Receiver] to receive messages.
 ///
 /// This receiver implements [Stream] for async usage.
-#[derive(Debug, Default)]
-pub struct AsyncMessageReceiver {}
+///
+/// Several receivers may be used by different tasks of the same executor, each
+/// with a [MessageFilter] selecting its messages; a message is delivered to the
+/// first task whose filter it matches. Messages arriving in a burst are queued
+/// in the inbox of their task, see [INBOX_SIZE](super::executor::local_data::INBOX_SIZE).
+///
+/// Messages are delivered to the task from the first wait on until the receiver
+/// is dropped, including while the task does not wait.
+#[derive(Debug)]
+pub struct AsyncMessageReceiver {
+    registration: MessageRegistration,
+}
 
 impl AsyncMessageReceiver {
-    /// Create a new receiver.
+    /// Create a new receiver for any message.
     pub fn new() -> Self {
-        Self {}
+        Self::with_filter(MessageFilter::Any)
+    }
+
+    /// Create a new receiver for the messages passing the filter.
+    pub fn with_filter(filter: MessageFilter) -> Self {
+        Self {
+            registration: MessageRegistration::new(filter),
+        }
     }
 
     /// Asynchronously wait for a message to be received.
     pub async fn wait(&mut self) -> RawMessage {
-        wait_for_message().await
+        poll_fn(|cx| self.registration.poll_message(cx)).await
+    }
+}
+
+impl Default for AsyncMessageReceiver {
+    fn default() -> Self {
+        Self::new()
     }
 }
 
@@ -429,9 +940,7 @@ impl Stream for AsyncMessageReceiver {
     type Item = RawMessage;
 
     fn poll_next(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<Option<Self::Item>> {
-        let future = wait_for_message();
-        pin_mut!(future);
-
-        future.poll(cx).map(Some)
+        let this = self.get_mut();
+        poll_budgeted(cx, |cx| this.registration.poll_message(cx).map(Some))
     }
 }
@@ -6,13 +6,22 @@
 pub mod auto_deploy;
 #[cfg(feature = "rt")]
 mod defmt_rtt;
+pub mod delay;
 pub mod events;
 pub mod executor;
+pub mod hrtimer;
+pub mod interrupt;
 pub mod messages;
+pub mod monitor;
 pub mod name_server;
 #[cfg(feature = "rt")]
 pub mod panic;
+pub mod periodic;
+pub mod rpc;
+pub mod schedule;
 pub mod task;
 pub mod ticker;
 pub mod time;
+pub mod timer;
+pub mod topic;
 pub mod tsim;
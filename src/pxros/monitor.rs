@@ -0,0 +1,541 @@
+//! Runtime deadline monitoring of periodic jobs.
+//!
+//! A [DeadlineMonitor] records when each activation of a job was released and
+//! completed, and checks the response time against a relative deadline:
+//!
+//! ```ignore
+//! static CONTROL_MISSES: AtomicU32 = AtomicU32::new(0);
+//!
+//! let mut monitor = DeadlineMonitor::new("control", Duration::from_millis(5))
+//!     .count_misses(&CONTROL_MISSES)
+//!     .signal_misses(TaskEvent::DEADLINE_MISS, supervisor)
+//!     .register();
+//! let mut ticker = AsyncDeadlineTicker::with_phase(TaskEvent::CONTROL, Duration::from_millis(5), Duration::ZERO);
+//!
+//! while let Some(activation) = ticker.next().await {
+//!     monitor.run_activation(activation?, control_step()).await;
+//! }
+//! ```
+//!
+//! Activations of a [DeadlineTicker](crate::pxros::periodic::DeadlineTicker)
+//! or [AsyncDeadlineTicker](crate::pxros::periodic::AsyncDeadlineTicker) are
+//! measured from their ideal release, so the latency of the timer and of the
+//! executor until the task is polled counts into the response time. The same
+//! holds for the ticks of an [AsyncTicker](crate::pxros::ticker::AsyncTicker),
+//! see [AsyncTicker::release](crate::pxros::ticker::AsyncTicker::release):
+//!
+//! ```ignore
+//! while ticker.next().await.is_some() {
+//!     monitor.run_at(ticker.release(), log_step()).await;
+//! }
+//! ```
+//!
+//! Jobs without a release time can be measured from when they start through
+//! [DeadlineMonitor::run]. A job still running at its deadline is reported as
+//! a miss right away, so hung jobs are noticed too. All times are taken on the
+//! [global timebase](Instant).
+//!
+//! # Registry
+//! [Registered](DeadlineMonitor::register) monitors publish their timing to a
+//! static registry of [MAX_MONITORS] entries, so a supervisor task, e.g. on
+//! another core, can dump the timing of all tasks through [log_summaries].
+
+use core::cell::UnsafeCell;
+use core::future::{poll_fn, Future};
+use core::sync::atomic::{fence, AtomicBool, AtomicU32, Ordering};
+use core::task::Poll;
+use core::time::Duration;
+
+use futures::pin_mut;
+use pxros::bindings::{PxEvents_t, PxTaskSignalEvents, PxTask_t};
+use pxros::PxResult;
+
+use super::events::Event;
+use super::periodic::Activation;
+use super::time::Instant;
+use super::timer::sleep;
+
+/// Number of monitors that can be registered at the same time.
+pub const MAX_MONITORS: usize = 16;
+
+/// Attempts to read an entry of the registry while its monitor updates it.
+const READ_ATTEMPTS: usize = 4;
+
+/// Timing recorded by a [DeadlineMonitor].
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default, defmt::Format)]
+pub struct DeadlineStats {
+    /// Number of completed activations.
+    pub activations: u32,
+    /// Number of activations completing after their deadline.
+    pub misses: u32,
+    /// Release time of the last activation.
+    pub last_activation: Option<Instant>,
+    /// Completion time of the last activation.
+    pub last_completion: Option<Instant>,
+    /// Response time of the last activation.
+    pub last_response: Duration,
+    /// Longest response time of an activation.
+    pub worst_response: Duration,
+}
+
+impl DeadlineStats {
+    /// Timing before the first activation.
+    const NONE: Self = Self {
+        activations: 0,
+        misses: 0,
+        last_activation: None,
+        last_completion: None,
+        last_response: Duration::ZERO,
+        worst_response: Duration::ZERO,
+    };
+}
+
+/// Timing of a monitor, as published to the registry.
+#[derive(Clone, Copy)]
+struct MonitorRecord {
+    name: &'static str,
+    deadline: Duration,
+    /// Release time of the running activation.
+    running: Option<Instant>,
+    stats: DeadlineStats,
+}
+
+impl MonitorRecord {
+    /// Log the timing, reporting a running activation past its deadline.
+    fn log(&self) {
+        if let Some(release) = self.running {
+            let running = release.elapsed();
+            if running > self.deadline {
+                defmt::warn!(
+                    "[DeadlineMonitor] {=str}: activation overdue, running for {} us",
+                    self.name,
+                    running.as_micros() as u64
+                );
+            }
+        }
+
+        defmt::info!(
+            "[DeadlineMonitor] {=str}: {} activations, {} misses, worst response {} us of {} us",
+            self.name,
+            self.stats.activations,
+            self.stats.misses,
+            self.stats.worst_response.as_micros() as u64,
+            self.deadline.as_micros() as u64
+        );
+    }
+}
+
+/// Entry of the registry, written by the monitor that claimed it.
+struct RegistrySlot {
+    used: AtomicBool,
+    /// Incremented before and after every write, so odd while the record is
+    /// being written.
+    sequence: AtomicU32,
+    record: UnsafeCell<MonitorRecord>,
+}
+
+// Safety: the record is only written by the monitor owning the slot, and read
+// through the sequence number, see RegistrySlot::read.
+unsafe impl Sync for RegistrySlot {}
+
+impl RegistrySlot {
+    /// Allows us to create an array of slots even if they are not copy.
+    #[allow(clippy::declare_interior_mutable_const)]
+    const FREE: RegistrySlot = RegistrySlot {
+        used: AtomicBool::new(false),
+        sequence: AtomicU32::new(0),
+        record: UnsafeCell::new(MonitorRecord {
+            name: "",
+            deadline: Duration::ZERO,
+            running: None,
+            stats: DeadlineStats::NONE,
+        }),
+    };
+
+    /// Claim a free slot.
+    fn claim() -> Option<&'static RegistrySlot> {
+        REGISTRY.iter().find(|slot| {
+            slot.used
+                .compare_exchange(false, true, Ordering::AcqRel, Ordering::Relaxed)
+                .is_ok()
+        })
+    }
+
+    /// Publish the record; only called by the monitor owning the slot.
+    fn write(&self, record: MonitorRecord) {
+        self.sequence.fetch_add(1, Ordering::Relaxed);
+        fence(Ordering::Release);
+        // Safety: only the owning monitor writes, readers detect the write
+        // through the sequence number.
+        unsafe { self.record.get().write_volatile(record) };
+        self.sequence.fetch_add(1, Ordering::Release);
+    }
+
+    /// Read a consistent copy of the record, if the slot is in use.
+    ///
+    /// Gives up after [READ_ATTEMPTS] if the owner keeps writing, e.g. because
+    /// it was preempted by the reading task while writing.
+    fn read(&self) -> Option<MonitorRecord> {
+        for _ in 0..READ_ATTEMPTS {
+            if !self.used.load(Ordering::Acquire) {
+                return None;
+            }
+
+            let before = self.sequence.load(Ordering::Acquire);
+            if before & 1 != 0 {
+                continue;
+            }
+            // Safety: a concurrent write is detected through the sequence
+            // number, and the copy discarded.
+            let record = unsafe { self.record.get().read_volatile() };
+            fence(Ordering::Acquire);
+            if self.sequence.load(Ordering::Relaxed) == before {
+                return Some(record);
+            }
+        }
+
+        defmt::warn!("[DeadlineMonitor] Skipped a monitor being updated");
+        None
+    }
+}
+
+static REGISTRY: [RegistrySlot; MAX_MONITORS] = [RegistrySlot::FREE; MAX_MONITORS];
+
+/// Log a summary of the timing of all [registered](DeadlineMonitor::register)
+/// monitors, reporting activations running past their deadline.
+pub fn log_summaries() {
+    for record in REGISTRY.iter().filter_map(RegistrySlot::read) {
+        record.log();
+    }
+}
+
+/// Deadline monitor of a periodic task or future.
+///
+/// See the [module](self) documentation for details.
+pub struct DeadlineMonitor {
+    name: &'static str,
+    deadline: Duration,
+    /// Incremented on every miss, e.g. to be read by a supervisor.
+    counter: Option<&'static AtomicU32>,
+    /// Events signalled to a task on every miss.
+    signal: Option<(PxTask_t, PxEvents_t)>,
+    /// Release time of the running activation.
+    activation: Option<Instant>,
+    /// The running activation was reported past its deadline already.
+    overdue: bool,
+    /// Entry of the registry, if registered.
+    slot: Option<&'static RegistrySlot>,
+    stats: DeadlineStats,
+}
+
+impl DeadlineMonitor {
+    /// Create a monitor checking the response time of each activation against
+    /// the deadline.
+    pub const fn new(name: &'static str, deadline: Duration) -> Self {
+        Self {
+            name,
+            deadline,
+            counter: None,
+            signal: None,
+            activation: None,
+            overdue: false,
+            slot: None,
+            stats: DeadlineStats::NONE,
+        }
+    }
+
+    /// Publish the timing to the registry, see [log_summaries].
+    ///
+    /// If all [MAX_MONITORS] entries are in use, a warning is logged and the
+    /// monitor works without being registered.
+    pub fn register(mut self) -> Self {
+        if self.slot.is_none() {
+            self.slot = RegistrySlot::claim();
+            match self.slot {
+                Some(_) => self.publish(),
+                None => defmt::warn!("[DeadlineMonitor] Registry full, {=str} not registered", self.name),
+            }
+        }
+        self
+    }
+
+    /// Increment the counter on every deadline miss.
+    pub const fn count_misses(mut self, counter: &'static AtomicU32) -> Self {
+        self.counter = Some(counter);
+        self
+    }
+
+    /// Signal the event to the task on every deadline miss.
+    pub fn signal_misses<E: Event>(mut self, event: E, task: PxTask_t) -> Self {
+        self.signal = Some((task, PxEvents_t(event.bits())));
+        self
+    }
+
+    /// Start an activation now.
+    pub fn activate(&mut self) {
+        self.activate_at(Instant::now())
+    }
+
+    /// Start an activation released at the given time.
+    ///
+    /// An activation still running is abandoned without being recorded.
+    pub fn activate_at(&mut self, release: Instant) {
+        self.activation = Some(release);
+        self.overdue = false;
+        self.stats.last_activation = Some(release);
+        self.publish();
+    }
+
+    /// Start the activation of a periodic timer, released at its ideal release
+    /// time.
+    pub fn activate_for(&mut self, activation: &Activation) {
+        self.activate_at(activation.release)
+    }
+
+    /// Complete the running activation now.
+    ///
+    /// Returns false if the deadline was missed; completing without an
+    /// activation has no effect and returns true.
+    pub fn complete(&mut self) -> bool {
+        let Some(release) = self.activation.take() else {
+            return true;
+        };
+
+        let completion = Instant::now();
+        let response = completion.duration_since(release);
+
+        self.stats.activations = self.stats.activations.wrapping_add(1);
+        self.stats.last_completion = Some(completion);
+        self.stats.last_response = response;
+        self.stats.worst_response = self.stats.worst_response.max(response);
+
+        // A miss reported while running is not counted again
+        let met = response <= self.deadline;
+        if !met && !core::mem::take(&mut self.overdue) {
+            self.miss(response);
+        }
+        self.publish();
+        met
+    }
+
+    /// Report the running activation as a miss if its deadline passed, before
+    /// it completes.
+    ///
+    /// Returns false if the deadline was missed; the activation is reported at
+    /// most once, and not again when it completes.
+    pub fn check_overdue(&mut self) -> bool {
+        let Some(release) = self.activation else {
+            return true;
+        };
+
+        let running = release.elapsed();
+        if running <= self.deadline {
+            return true;
+        }
+
+        if !self.overdue {
+            self.overdue = true;
+            self.miss(running);
+            self.publish();
+        }
+        false
+    }
+
+    /// Run the future as one activation, starting when this is called and
+    /// completing once the future does.
+    ///
+    /// The time until the job is released is not measured; prefer
+    /// [DeadlineMonitor::run_activation] or [DeadlineMonitor::run_at] for
+    /// periodic jobs. See [DeadlineMonitor::run_at] for details.
+    pub async fn run<F: Future>(&mut self, future: F) -> F::Output {
+        self.run_at(Instant::now(), future).await
+    }
+
+    /// Run the future as the activation of a periodic timer, measured from the
+    /// ideal release of the activation until the future completes.
+    ///
+    /// See [DeadlineMonitor::run_at] for details.
+    pub async fn run_activation<F: Future>(&mut self, activation: Activation, future: F) -> F::Output {
+        self.run_at(activation.release, future).await
+    }
+
+    /// Run the future as one activation released at the given time, measured
+    /// until the future completes.
+    ///
+    /// If the future is still running at its deadline, the miss is reported
+    /// right away, see [DeadlineMonitor::check_overdue].
+    ///
+    /// # Panics
+    /// This will panic if polled outside the
+    /// [PxrosExecutor](crate::pxros::executor::PxrosExecutor), which keeps the
+    /// deadline, see [sleep].
+    pub async fn run_at<F: Future>(&mut self, release: Instant, future: F) -> F::Output {
+        self.activate_at(release);
+
+        let expiry = sleep(self.deadline.saturating_sub(release.elapsed()));
+        pin_mut!(future, expiry);
+        let mut watching = true;
+
+        let output = poll_fn(|cx| {
+            if let Poll::Ready(output) = future.as_mut().poll(cx) {
+                return Poll::Ready(output);
+            }
+            if watching && expiry.as_mut().poll(cx).is_ready() {
+                watching = false;
+                self.check_overdue();
+            }
+            Poll::Pending
+        })
+        .await;
+
+        self.complete();
+        output
+    }
+
+    /// Returns the timing recorded so far.
+    pub const fn stats(&self) -> DeadlineStats {
+        self.stats
+    }
+
+    /// Log a summary of the timing recorded so far; see [log_summaries] for
+    /// all registered monitors.
+    pub fn log_summary(&self) {
+        self.record().log();
+    }
+
+    /// Returns the timing to be published.
+    const fn record(&self) -> MonitorRecord {
+        MonitorRecord {
+            name: self.name,
+            deadline: self.deadline,
+            running: self.activation,
+            stats: self.stats,
+        }
+    }
+
+    /// Publish the timing to the registry, if registered.
+    fn publish(&self) {
+        if let Some(slot) = self.slot {
+            slot.write(self.record());
+        }
+    }
+
+    /// Record a deadline miss and notify about it.
+    fn miss(&mut self, response: Duration) {
+        self.stats.misses = self.stats.misses.saturating_add(1);
+        defmt::warn!("[DeadlineMonitor] {=str} missed its deadline: {} us", self.name, response.as_micros() as u64);
+
+        if let Some(counter) = self.counter {
+            counter.fetch_add(1, Ordering::Relaxed);
+        }
+
+        if let Some((task, events)) = self.signal {
+            // Safety: this is safe to call only from tasks.
+            let result = unsafe { PxTaskSignalEvents(task, events) };
+            if let Err(error) = PxResult::from(result) {
+                defmt::error!("[DeadlineMonitor] Failed to signal the miss: {}", error);
+            }
+        }
+    }
+}
+
+impl Drop for DeadlineMonitor {
+    fn drop(&mut self) {
+        if let Some(slot) = self.slot.take() {
+            slot.used.store(false, Ordering::Release);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use core::sync::atomic::{AtomicU32, Ordering};
+    use core::time::Duration;
+
+    use super::{DeadlineMonitor, RegistrySlot, REGISTRY};
+    use crate::pxros::periodic::Schedule;
+    use crate::pxros::time::{host, Instant};
+
+    #[test]
+    fn misses_are_recorded_and_counted() {
+        static MISSES: AtomicU32 = AtomicU32::new(0);
+        let mut monitor = DeadlineMonitor::new("test", Duration::from_millis(1)).count_misses(&MISSES);
+
+        monitor.activate();
+        assert!(monitor.complete());
+
+        // Measured from the ideal release
+        monitor.activate_at(Instant::now());
+        host::advance(Duration::from_millis(2));
+        assert!(!monitor.complete());
+
+        // Nothing to complete
+        assert!(monitor.complete());
+
+        let stats = monitor.stats();
+        assert_eq!(stats.activations, 2);
+        assert_eq!(stats.misses, 1);
+        assert!(stats.worst_response >= Duration::from_millis(2));
+        assert_eq!(stats.last_response, stats.worst_response);
+        assert_eq!(MISSES.load(Ordering::Relaxed), 1);
+    }
+
+    #[test]
+    fn overdue_activations_are_reported_once() {
+        let mut monitor = DeadlineMonitor::new("test", Duration::from_millis(1));
+
+        monitor.activate();
+        assert!(monitor.check_overdue());
+        host::advance(Duration::from_millis(2));
+        assert!(!monitor.check_overdue());
+        assert!(!monitor.check_overdue());
+        assert_eq!(monitor.stats().misses, 1);
+
+        // Completing late is the same miss
+        assert!(!monitor.complete());
+        let stats = monitor.stats();
+        assert_eq!(stats.activations, 1);
+        assert_eq!(stats.misses, 1);
+    }
+
+    #[test]
+    fn registered_monitors_publish_their_timing() {
+        let published = || {
+            REGISTRY
+                .iter()
+                .filter_map(RegistrySlot::read)
+                .find(|record| record.name == "registered")
+        };
+
+        let mut monitor = DeadlineMonitor::new("registered", Duration::from_millis(1)).register();
+        monitor.activate();
+        assert!(published().is_some_and(|record| record.running.is_some()));
+
+        assert!(monitor.complete());
+        let record = published().expect("The monitor is registered");
+        assert!(record.running.is_none());
+        assert_eq!(record.stats, monitor.stats());
+
+        // The entry is free again
+        drop(monitor);
+        assert!(published().is_none());
+    }
+
+    #[test]
+    fn activations_are_measured_from_their_release() {
+        let mut monitor = DeadlineMonitor::new("test", Duration::from_millis(1));
+        let release = Instant::now();
+        let mut schedule = Schedule::new(Duration::from_millis(10), release);
+
+        // Released late, e.g. by the timer or the executor
+        host::advance(Duration::from_micros(800));
+        let activation = schedule.activate(Instant::now());
+        monitor.activate_for(&activation);
+        host::advance(Duration::from_micros(400));
+        assert!(!monitor.complete());
+
+        let stats = monitor.stats();
+        assert_eq!(stats.last_activation, Some(release));
+        assert!(stats.last_response >= Duration::from_micros(1200));
+    }
+}
@@ -0,0 +1,273 @@
+//! Periodic timers with absolute release times.
+//!
+//! Unlike [Ticker](crate::pxros::ticker::Ticker), whose period restarts from
+//! each kernel event, a [DeadlineTicker] computes every release time from the
+//! first one, `first + n * period`, on the [global timebase](Instant). Delays of
+//! single activations thus do not accumulate, and loops on any core can run at
+//! fixed phase offsets against each other:
+//!
+//! ```ignore
+//! // Two 10 ms loops, released 5 ms apart
+//! let control = AsyncDeadlineTicker::with_phase(AsyncEvent::CONTROL, Duration::from_millis(10), Duration::ZERO);
+//! let monitor = AsyncDeadlineTicker::with_phase(AsyncEvent::MONITOR, Duration::from_millis(10), Duration::from_millis(5));
+//!
+//! while let Some(activation) = control.next().await {
+//!     let activation = activation?;
+//!     defmt::debug!("Control loop {} us late", activation.lateness.as_micros());
+//!     // ...
+//! }
+//! ```
+//!
+//! Release times are signalled through [HrTimer]s, so they have the resolution
+//! of the System Timer.
+
+use core::pin::Pin;
+use core::task::{ready, Context, Poll};
+use core::time::Duration;
+
+use futures::Stream;
+use pxros::PxResult;
+
+use super::events::Event;
+use super::executor::local_data::PxrosData;
+use super::hrtimer::HrTimer;
+use super::time::{duration_to_stm_ticks, stm_ticks_to_duration, Instant};
+use crate::executor::budget::poll_budgeted;
+
+/// One activation of a periodic timer.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, defmt::Format)]
+pub struct Activation {
+    /// Ideal release time of this activation, the latest one that passed.
+    pub release: Instant,
+    /// Time between the release and the activation, at most one period.
+    pub lateness: Duration,
+    /// Releases that passed before [Activation::release] and were skipped.
+    pub missed: u32,
+}
+
+/// Release times of a periodic timer.
+#[derive(Debug, Clone, Copy)]
+pub(super) struct Schedule {
+    /// Period in System Timer ticks.
+    period: u64,
+    /// Next release time.
+    next: Instant,
+}
+
+impl Schedule {
+    /// Create a schedule releasing at `first` and every period thereafter.
+    ///
+    /// # Panics
+    /// This will panic if the period is zero or too long for the System Timer.
+    pub(super) fn new(period: Duration, first: Instant) -> Self {
+        let period = duration_to_stm_ticks(period).expect("Period too long for the System Timer");
+        assert!(period != 0, "The period must not be zero");
+
+        Self { period, next: first }
+    }
+
+    /// Create a schedule releasing at multiples of the period, shifted by the
+    /// phase, starting with the first release at or after `now`.
+    fn with_phase(period: Duration, phase: Duration, now: Instant) -> Self {
+        let mut schedule = Self::new(period, Instant::from_ticks(0));
+        let phase = duration_to_stm_ticks(phase).expect("Phase too long for the System Timer") % schedule.period;
+
+        let periods = now.ticks().saturating_sub(phase).div_ceil(schedule.period);
+        schedule.next = Instant::from_ticks(phase + periods * schedule.period);
+        schedule
+    }
+
+    /// Activate the latest release that passed at `now`, skipping the ones
+    /// before it.
+    pub(super) fn activate(&mut self, now: Instant) -> Activation {
+        let late = now.ticks().saturating_sub(self.next.ticks());
+        let missed = late / self.period;
+        let release = Instant::from_ticks(self.next.ticks() + missed * self.period);
+
+        self.next = Instant::from_ticks(release.ticks() + self.period);
+        Activation {
+            release,
+            lateness: stm_ticks_to_duration(late - missed * self.period),
+            missed: u32::try_from(missed).unwrap_or(u32::MAX),
+        }
+    }
+}
+
+/// A periodic timer releasing at absolute times.
+///
+/// See the [module](self) documentation for details; for the async variant
+/// refer to [AsyncDeadlineTicker].
+pub struct DeadlineTicker<E: Event> {
+    event: E,
+    schedule: Schedule,
+}
+
+impl<E: Event> DeadlineTicker<E> {
+    /// Create a timer releasing at `first` and every period thereafter.
+    ///
+    /// # Panics
+    /// This will panic if the period is zero or too long for the System Timer.
+    pub fn starting_at(event: E, period: Duration, first: Instant) -> Self {
+        Self {
+            event,
+            schedule: Schedule::new(period, first),
+        }
+    }
+
+    /// Create a timer releasing at multiples of the period on the global
+    /// timebase, shifted by the phase.
+    ///
+    /// Timers with the same period and phase release at the same times, on any
+    /// core.
+    ///
+    /// # Panics
+    /// This will panic if the period is zero or too long for the System Timer.
+    pub fn with_phase(event: E, period: Duration, phase: Duration) -> Self {
+        Self {
+            event,
+            schedule: Schedule::with_phase(period, phase, Instant::now()),
+        }
+    }
+
+    /// Waits for the next release in blocking manner.
+    ///
+    /// If releases passed meanwhile, returns right away and skips the ones
+    /// before the last; see [Activation::missed].
+    ///
+    /// This may return error if the [HrTimer] cannot be started.
+    pub fn wait(&mut self) -> PxResult<Activation> {
+        let release = self.schedule.next;
+
+        // The event may also stem from a previous timer, so the release time is checked
+        while Instant::now() < release {
+            HrTimer::at(self.event, release)?.wait();
+        }
+
+        Ok(self.schedule.activate(Instant::now()))
+    }
+
+    /// Returns the next release time.
+    pub const fn next_release(&self) -> Instant {
+        self.schedule.next
+    }
+}
+
+/// Async variant of [DeadlineTicker].
+///
+/// This timer implements [Stream] for async usage; the [HrTimer] for a release
+/// is started once the stream is polled for it.
+pub struct AsyncDeadlineTicker<E: Event> {
+    ticker: DeadlineTicker<E>,
+    timer: Option<HrTimer<E>>,
+}
+
+impl<E: Event + Unpin> AsyncDeadlineTicker<E> {
+    /// Create a timer releasing at `first` and every period thereafter.
+    ///
+    /// See [DeadlineTicker::starting_at] for details.
+    pub fn starting_at(event: E, period: Duration, first: Instant) -> Self {
+        Self {
+            ticker: DeadlineTicker::starting_at(event, period, first),
+            timer: None,
+        }
+    }
+
+    /// Create a timer releasing at multiples of the period, shifted by the
+    /// phase.
+    ///
+    /// See [DeadlineTicker::with_phase] for details.
+    pub fn with_phase(event: E, period: Duration, phase: Duration) -> Self {
+        Self {
+            ticker: DeadlineTicker::with_phase(event, period, phase),
+            timer: None,
+        }
+    }
+
+    /// Returns the next release time.
+    pub const fn next_release(&self) -> Instant {
+        self.ticker.next_release()
+    }
+
+    /// Poll for the next activation, see [Stream::poll_next].
+    fn poll_activation(&mut self, context: &mut Context<'_>) -> Poll<Option<PxResult<Activation>>> {
+        let event = self.ticker.event;
+        let release = self.ticker.schedule.next;
+
+        // The event may also stem from a previous timer, so the release time is checked
+        while Instant::now() < release {
+            if self.timer.is_none() {
+                match HrTimer::at(event, release) {
+                    Ok(timer) => self.timer = Some(timer),
+                    Err(error) => return Poll::Ready(Some(Err(error))),
+                }
+            }
+
+            ready!(PxrosData::access(|data| data.poll_event(event), context));
+        }
+
+        self.timer = None;
+        let activation = self.ticker.schedule.activate(Instant::now());
+        Poll::Ready(Some(Ok(activation)))
+    }
+}
+
+impl<E: Event + Unpin> Stream for AsyncDeadlineTicker<E> {
+    type Item = PxResult<Activation>;
+
+    fn poll_next(self: Pin<&mut Self>, context: &mut Context<'_>) -> Poll<Option<Self::Item>> {
+        let this = self.get_mut();
+        poll_budgeted(context, |context| this.poll_activation(context))
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use core::time::Duration;
+
+    use super::Schedule;
+    use crate::pxros::time::Instant;
+
+    const MS: u64 = 100_000;
+
+    #[test]
+    fn releases_do_not_drift() {
+        let mut schedule = Schedule::new(Duration::from_millis(10), Instant::from_ticks(0));
+
+        let activation = schedule.activate(Instant::from_ticks(3 * MS));
+        assert_eq!(activation.release, Instant::from_ticks(0));
+        assert_eq!(activation.lateness, Duration::from_millis(3));
+        assert_eq!(activation.missed, 0);
+
+        // The lateness of one activation does not shift the next release
+        let activation = schedule.activate(Instant::from_ticks(10 * MS));
+        assert_eq!(activation.release, Instant::from_ticks(10 * MS));
+        assert_eq!(activation.lateness, Duration::ZERO);
+    }
+
+    #[test]
+    fn passed_releases_are_skipped() {
+        let mut schedule = Schedule::new(Duration::from_millis(10), Instant::from_ticks(0));
+
+        let activation = schedule.activate(Instant::from_ticks(25 * MS));
+        assert_eq!(activation.missed, 2);
+        assert_eq!(activation.release, Instant::from_ticks(20 * MS));
+        assert_eq!(activation.lateness, Duration::from_millis(5));
+        assert_eq!(schedule.next, Instant::from_ticks(30 * MS));
+    }
+
+    #[test]
+    fn phases_align_to_the_timebase() {
+        let period = Duration::from_millis(10);
+
+        let first = Schedule::with_phase(period, Duration::ZERO, Instant::from_ticks(12 * MS));
+        let second = Schedule::with_phase(period, Duration::from_millis(5), Instant::from_ticks(12 * MS));
+        let exact = Schedule::with_phase(period, Duration::from_millis(5), Instant::from_ticks(15 * MS));
+
+        assert_eq!(first.next, Instant::from_ticks(20 * MS));
+        assert_eq!(second.next, Instant::from_ticks(15 * MS));
+        assert_eq!(exact.next, Instant::from_ticks(15 * MS));
+
+        let early = Schedule::with_phase(period, Duration::from_millis(5), Instant::from_ticks(MS));
+        assert_eq!(early.next, Instant::from_ticks(5 * MS));
+    }
+}
@@ -0,0 +1,314 @@
+//! Request/response calls over PXROS mailboxes.
+//!
+//! An [RpcClient] stamps a correlation ID into the metadata of each request and
+//! keeps it in a fixed table of outstanding calls until the matching reply
+//! arrives; the server answers through [reply], which stamps the same ID into
+//! the reply. Several requests can thus be pipelined to one server, and replies
+//! are matched to their calls in any order:
+//!
+//! ```ignore
+//! // Client, in an async task of the PxrosExecutor
+//! let mut client = RpcClient::<4>::new(server)?;
+//! let first = client.send(first_request)?;
+//! let second = client.send(second_request)?;
+//! let (first, second) = (client.reply(first).await?, client.reply(second).await?);
+//!
+//! // Server
+//! loop {
+//!     let request = RawMessage::receive(mailbox)?;
+//!     let response = handle(&request)?;
+//!     rpc::reply(request, response)?;
+//! }
+//! ```
+//!
+//! ## Note
+//! The metadata of requests and replies is owned by this module. Replies are
+//! sent to the mailbox of the calling task, which the executor of the client
+//! must receive from. Every client stamps a discriminator next to the
+//! correlation ID, so several clients of one executor only receive their own
+//! replies; an async task should wait on one client at a time, see
+//! [wait_for_message_matching].
+
+use core::sync::atomic::{AtomicU16, Ordering};
+
+use pxros::bindings::{PxError_t, PxMbx_t, PxMsgMetadata_t, PxTaskGetMbx, PxTask_t};
+use pxros::PxResult;
+
+use super::executor::local_data::wait_for_message_matching;
+use super::messages::{MessageFilter, RawMessage};
+
+/// Marks the metadata of a request; the correlation takes the lower bits.
+const REQUEST_TAG: u32 = 0b10 << 30;
+/// Marks the metadata of a reply; the correlation takes the lower bits.
+const REPLY_TAG: u32 = 0b11 << 30;
+const TAG_MASK: u32 = 0b11 << 30;
+/// Discriminator of the client in the correlation, above the correlation ID.
+const CLIENT_SHIFT: u32 = 16;
+const CLIENT_MASK: u32 = 0x3FFF << CLIENT_SHIFT;
+
+/// Discriminator of the next client; clients only share one after 16384 more
+/// were created.
+static NEXT_CLIENT: AtomicU16 = AtomicU16::new(0);
+
+/// Messages that are requests of an [RpcClient], e.g. for a server sharing its
+/// mailbox with other messages.
+pub const REQUESTS: MessageFilter = MessageFilter::Custom(is_request);
+
+/// Identifies an outstanding call of an [RpcClient].
+#[derive(Debug, Clone, Copy, PartialEq, Eq, defmt::Format)]
+pub struct CallId(u16);
+
+/// Returns the correlation, client discriminator and ID, if the metadata
+/// carries the tag.
+const fn correlation(metadata: u32, tag: u32) -> Option<u32> {
+    if metadata & TAG_MASK == tag {
+        Some(metadata & !TAG_MASK)
+    } else {
+        None
+    }
+}
+
+/// Returns true if the message is a request of an [RpcClient].
+pub fn is_request(message: &RawMessage) -> bool {
+    message
+        .metadata()
+        .is_ok_and(|metadata| correlation(metadata.0, REQUEST_TAG).is_some())
+}
+
+/// Answer a request with the response, releasing the request.
+///
+/// The response is sent to the mailbox of the task that sent the request; on
+/// failure, it is released as well.
+pub fn reply(mut request: RawMessage, mut response: RawMessage) -> PxResult<()> {
+    let target = request
+        .metadata()
+        .ok()
+        .and_then(|metadata| correlation(metadata.0, REQUEST_TAG))
+        .ok_or(PxError_t::PXERR_REQUEST_INVALID_PARAMETER)
+        .and_then(|id| request.sender().map(|sender| (id, sender)));
+    if let Err(error) = request.release() {
+        defmt::warn!("Request could not be released: {}", error);
+    }
+
+    let result = target.and_then(|(correlation, sender)| {
+        // Safety: this is safe to call and errors are handled
+        let mailbox = unsafe { PxTaskGetMbx(sender) }.checked()?;
+        response.set_metadata(PxMsgMetadata_t(REPLY_TAG | correlation))?;
+        response.send(mailbox)
+    });
+    if result.is_err() {
+        if let Err(error) = response.release() {
+            defmt::warn!("Response could not be released: {}", error);
+        }
+    }
+    result
+}
+
+/// State of an outstanding call.
+struct Call {
+    id: u16,
+    reply: Option<RawMessage>,
+}
+
+/// Client side of request/response calls to one server, with up to `N`
+/// outstanding calls.
+///
+/// See the [module](self) documentation for details.
+pub struct RpcClient<const N: usize> {
+    server: PxMbx_t,
+    /// Discriminator of the client, stamped into the correlation.
+    client: u32,
+    calls: [Option<Call>; N],
+    /// Correlation ID of the last call.
+    last_id: u16,
+}
+
+impl<const N: usize> RpcClient<N> {
+    /// Create a client calling the task.
+    ///
+    /// See [PxTaskGetMbx] for details and failure reasons.
+    pub fn new(server: PxTask_t) -> PxResult<Self> {
+        // Safety: this is safe to call and errors are handled
+        let server = unsafe { PxTaskGetMbx(server) }.checked()?;
+        Ok(Self::with_mailbox(server))
+    }
+
+    /// Create a client sending its requests to the mailbox.
+    pub fn with_mailbox(server: PxMbx_t) -> Self {
+        let client = NEXT_CLIENT.fetch_add(1, Ordering::Relaxed);
+
+        Self {
+            server,
+            client: (u32::from(client) << CLIENT_SHIFT) & CLIENT_MASK,
+            calls: [(); N].map(|_| None),
+            last_id: 0,
+        }
+    }
+
+    /// Send a request without waiting for its reply, see [RpcClient::reply].
+    ///
+    /// Returns [PxError_t::PXERR_REQUEST_FAILED] if `N` calls are
+    /// outstanding; the request is released on failure.
+    pub fn send(&mut self, mut request: RawMessage) -> PxResult<CallId> {
+        let result = self.start().and_then(|(slot, id)| {
+            request.set_metadata(PxMsgMetadata_t(REQUEST_TAG | self.client | u32::from(id)))?;
+            request.send(self.server)?;
+            self.calls[slot] = Some(Call { id, reply: None });
+            Ok(CallId(id))
+        });
+
+        if result.is_err() {
+            if let Err(error) = request.release() {
+                defmt::warn!("Request could not be released: {}", error);
+            }
+        }
+        result
+    }
+
+    /// Send a request and asynchronously wait for its reply.
+    pub async fn call(&mut self, request: RawMessage) -> PxResult<RawMessage> {
+        let id = self.send(request)?;
+        self.reply(id).await
+    }
+
+    /// Asynchronously wait for the reply to the call.
+    ///
+    /// Replies to other calls arriving meanwhile are kept for them; while
+    /// waiting, the task receives the replies to this client only, see
+    /// [wait_for_message_matching]. Returns
+    /// [PxError_t::PXERR_REQUEST_INVALID_PARAMETER] if the call is not
+    /// outstanding, e.g. because its reply was taken already.
+    ///
+    /// # Panics
+    /// This will panic if called outside the
+    /// [PxrosExecutor](super::executor::PxrosExecutor).
+    pub async fn reply(&mut self, id: CallId) -> PxResult<RawMessage> {
+        let slot = self.slot(id).ok_or(PxError_t::PXERR_REQUEST_INVALID_PARAMETER)?;
+
+        loop {
+            if let Some(reply) = self.calls[slot].as_mut().and_then(|call| call.reply.take()) {
+                self.calls[slot] = None;
+                return Ok(reply);
+            }
+
+            let message = wait_for_message_matching(self.replies()).await;
+            self.dispatch(message);
+        }
+    }
+
+    /// Give up on the call; its reply is released if it arrived or once it
+    /// arrives.
+    pub fn cancel(&mut self, id: CallId) {
+        if let Some(slot) = self.slot(id) {
+            if let Some(mut reply) = self.calls[slot].take().and_then(|call| call.reply) {
+                if let Err(error) = reply.release() {
+                    defmt::warn!("Reply could not be released: {}", error);
+                }
+            }
+        }
+    }
+
+    /// Returns the number of outstanding calls.
+    pub fn outstanding(&self) -> usize {
+        self.calls.iter().filter(|call| call.is_some()).count()
+    }
+
+    /// Messages that are replies to this client.
+    const fn replies(&self) -> MessageFilter {
+        MessageFilter::MetadataMasked {
+            mask: TAG_MASK | CLIENT_MASK,
+            value: REPLY_TAG | self.client,
+        }
+    }
+
+    /// Returns a free slot of the table and a correlation ID not in use.
+    fn start(&mut self) -> PxResult<(usize, u16)> {
+        let slot = self.calls.iter().position(Option::is_none);
+        let slot = slot.ok_or(PxError_t::PXERR_REQUEST_FAILED)?;
+
+        // At most N IDs are in use, so one of the next N + 1 is free
+        loop {
+            self.last_id = self.last_id.wrapping_add(1);
+            if self.slot(CallId(self.last_id)).is_none() {
+                return Ok((slot, self.last_id));
+            }
+        }
+    }
+
+    /// Returns the slot of the outstanding call.
+    fn slot(&self, id: CallId) -> Option<usize> {
+        self.calls
+            .iter()
+            .position(|call| call.as_ref().is_some_and(|call| call.id == id.0))
+    }
+
+    /// Keep the reply for its call, or release it if the call is unknown.
+    fn dispatch(&mut self, mut message: RawMessage) {
+        let id = message
+            .metadata()
+            .ok()
+            .and_then(|metadata| correlation(metadata.0, REPLY_TAG))
+            .filter(|correlation| correlation & CLIENT_MASK == self.client)
+            .map(|correlation| correlation as u16);
+        let call = id.and_then(|id| {
+            self.calls
+                .iter_mut()
+                .flatten()
+                .find(|call| call.id == id && call.reply.is_none())
+        });
+
+        match call {
+            Some(call) => call.reply = Some(message),
+            None => {
+                defmt::debug!("[RpcClient] Releasing reply to an unknown call: {}", id);
+                if let Err(error) = message.release() {
+                    defmt::warn!("Reply could not be released: {}", error);
+                }
+            },
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use pxros::bindings::PxMbx_t;
+
+    use super::{correlation, Call, CallId, RpcClient, CLIENT_MASK, REPLY_TAG, REQUEST_TAG};
+
+    #[test]
+    fn correlation_ids_are_tagged() {
+        assert_eq!(correlation(REQUEST_TAG | 7, REQUEST_TAG), Some(7));
+        assert_eq!(correlation(REQUEST_TAG | 7, REPLY_TAG), None);
+        assert_eq!(correlation(7, REPLY_TAG), None);
+        assert_eq!(correlation(REPLY_TAG | CLIENT_MASK | 7, REPLY_TAG), Some(CLIENT_MASK | 7));
+    }
+
+    #[test]
+    fn clients_are_told_apart() {
+        let first = RpcClient::<1>::with_mailbox(PxMbx_t::invalid());
+        let second = RpcClient::<1>::with_mailbox(PxMbx_t::invalid());
+
+        assert_ne!(first.client, second.client);
+        assert_eq!(first.client & !CLIENT_MASK, 0);
+    }
+
+    #[test]
+    fn ids_in_use_are_skipped() {
+        let mut client = RpcClient::<2>::with_mailbox(PxMbx_t::invalid());
+
+        let (slot, id) = client.start().unwrap();
+        client.calls[slot] = Some(Call { id, reply: None });
+        // Wrap around onto the outstanding call
+        client.last_id = id.wrapping_sub(1);
+
+        let (other, next) = client.start().unwrap();
+        assert_ne!(other, slot);
+        assert_eq!(next, id.wrapping_add(1));
+        client.calls[other] = Some(Call { id: next, reply: None });
+
+        assert!(client.start().is_err());
+        assert_eq!(client.outstanding(), 2);
+        client.cancel(CallId(id));
+        assert_eq!(client.outstanding(), 1);
+    }
+}
@@ -0,0 +1,320 @@
+//! Time-triggered schedule table for periodic runnables.
+//!
+//! Instead of one [Ticker](crate::pxros::ticker::Ticker) loop per periodic job,
+//! each with its own kernel object and event, a [ScheduleTable] runs all jobs of
+//! a task from a single base-rate timer. Runnables are registered with a period
+//! and an offset, both multiples of the base rate, so jobs of different rates can
+//! be spread over the base ticks rather than all running at the same one:
+//!
+//! ```ignore
+//! let mut table = ScheduleTable::<4>::new(Duration::from_millis(1));
+//! table.add("control", Duration::from_millis(5), Duration::ZERO, Duration::from_micros(200), &mut control)?;
+//! table.add("monitor", Duration::from_millis(10), Duration::from_millis(1), Duration::from_micros(300), &mut monitor)?;
+//! let offset = table.spread_offset(Duration::from_millis(100));
+//! table.add("report", Duration::from_millis(100), offset, Duration::from_millis(1), &mut report)?;
+//!
+//! table.run(TaskEvent::Schedule)?;
+//! ```
+//!
+//! The execution time of every activation is measured on the
+//! [global timebase](Instant) against the budget of the runnable, see
+//! [RunnableStats].
+
+use core::convert::Infallible;
+use core::time::Duration;
+
+use heapless::Vec;
+use pxros::PxResult;
+
+use super::events::Event;
+use super::periodic::{Activation, DeadlineTicker};
+use super::time::{duration_to_stm_ticks, stm_ticks_to_duration, Instant};
+
+/// Error returned when a runnable cannot be added to a [ScheduleTable].
+#[derive(Debug, Clone, Copy, PartialEq, Eq, defmt::Format)]
+pub enum ScheduleError {
+    /// The table has no room for another runnable.
+    TableFull,
+    /// The period is zero or not a multiple of the base rate.
+    InvalidPeriod,
+    /// The offset is not a multiple of the base rate or not shorter than the
+    /// period.
+    InvalidOffset,
+}
+
+/// Timing of a runnable since it was added to its [ScheduleTable].
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default, defmt::Format)]
+pub struct RunnableStats {
+    /// Number of times the runnable ran.
+    pub activations: u32,
+    /// Execution time of the last activation.
+    pub last_execution: Duration,
+    /// Longest execution time of an activation.
+    pub worst_execution: Duration,
+    /// Number of activations exceeding the budget.
+    pub budget_overruns: u32,
+    /// Number of releases skipped because the table fell behind the base rate.
+    pub skipped: u32,
+}
+
+/// A periodic job of a [ScheduleTable].
+struct Runnable<'a> {
+    name: &'static str,
+    /// Period in base ticks.
+    period: u64,
+    /// Offset in base ticks, shorter than the period.
+    offset: u64,
+    budget: Duration,
+    job: &'a mut dyn FnMut(),
+    stats: RunnableStats,
+}
+
+impl Runnable<'_> {
+    /// Returns true if the runnable is released at the given base tick.
+    const fn is_due(&self, tick: u64) -> bool {
+        tick % self.period == self.offset
+    }
+
+    /// Number of releases at base ticks before the given one.
+    const fn releases_before(&self, tick: u64) -> u64 {
+        if tick <= self.offset {
+            0
+        } else {
+            (tick - 1 - self.offset) / self.period + 1
+        }
+    }
+
+    /// Run the job, measuring its execution time.
+    fn run(&mut self) {
+        let start = Instant::now();
+        (self.job)();
+        let execution = start.elapsed();
+
+        self.stats.activations = self.stats.activations.wrapping_add(1);
+        self.stats.last_execution = execution;
+        self.stats.worst_execution = self.stats.worst_execution.max(execution);
+        if execution > self.budget {
+            self.stats.budget_overruns = self.stats.budget_overruns.saturating_add(1);
+            defmt::debug!("[ScheduleTable] {=str} exceeded its budget: {} us", self.name, execution.as_micros() as u64);
+        }
+    }
+}
+
+/// A table of up to `N` periodic runnables driven by one base-rate timer.
+///
+/// See the [module](self) documentation for details.
+pub struct ScheduleTable<'a, const N: usize> {
+    /// Base rate in System Timer ticks.
+    base: u64,
+    runnables: Vec<Runnable<'a>, N>,
+}
+
+impl<'a, const N: usize> ScheduleTable<'a, N> {
+    /// Create an empty table running at the given base rate.
+    ///
+    /// # Panics
+    /// This will panic if the base rate is zero or too long for the System Timer.
+    pub fn new(base: Duration) -> Self {
+        let base = duration_to_stm_ticks(base).expect("Base rate too long for the System Timer");
+        assert!(base != 0, "The base rate must not be zero");
+
+        Self {
+            base,
+            runnables: Vec::new(),
+        }
+    }
+
+    /// Add a runnable released every period, shifted by the offset; its
+    /// execution time is checked against the budget.
+    ///
+    /// Returns the index of the runnable, see [ScheduleTable::stats].
+    pub fn add(
+        &mut self,
+        name: &'static str,
+        period: Duration,
+        offset: Duration,
+        budget: Duration,
+        job: &'a mut dyn FnMut(),
+    ) -> Result<usize, ScheduleError> {
+        let period = self.base_ticks(period).filter(|&period| period != 0);
+        let period = period.ok_or(ScheduleError::InvalidPeriod)?;
+        let offset = self.base_ticks(offset).filter(|&offset| offset < period);
+        let offset = offset.ok_or(ScheduleError::InvalidOffset)?;
+
+        let runnable = Runnable {
+            name,
+            period,
+            offset,
+            budget,
+            job,
+            stats: RunnableStats::default(),
+        };
+        self.runnables.push(runnable).map_err(|_| ScheduleError::TableFull)?;
+        Ok(self.runnables.len() - 1)
+    }
+
+    /// Return the offset at which a runnable with the given period shares its
+    /// base ticks with the fewest runnables already in the table.
+    ///
+    /// A period that is not a multiple of the base rate returns a zero offset,
+    /// which [ScheduleTable::add] rejects along with the period.
+    pub fn spread_offset(&self, period: Duration) -> Duration {
+        let Some(period) = self.base_ticks(period).filter(|&period| period != 0) else {
+            return Duration::ZERO;
+        };
+
+        let load = |offset: u64| {
+            self.runnables
+                .iter()
+                .filter(|runnable| {
+                    // Two runnables meet if their offsets agree modulo the
+                    // greatest common divisor of their periods
+                    let common = gcd(period, runnable.period);
+                    offset % common == runnable.offset % common
+                })
+                .count()
+        };
+        let offset = (0..period).min_by_key(|&offset| load(offset)).unwrap_or(0);
+
+        stm_ticks_to_duration(offset * self.base)
+    }
+
+    /// Run the table, waiting for the base rate in blocking manner.
+    ///
+    /// Base ticks are aligned to the [global timebase](Instant), so tables with
+    /// the same base rate tick together on all cores. If the table falls behind,
+    /// the releases of the missed base ticks are skipped and counted, see
+    /// [RunnableStats::skipped].
+    ///
+    /// This returns only if the timer of the base rate fails, see
+    /// [DeadlineTicker::wait].
+    pub fn run<E: Event>(&mut self, event: E) -> PxResult<Infallible> {
+        let base = stm_ticks_to_duration(self.base);
+        let mut ticker = DeadlineTicker::with_phase(event, base, Duration::ZERO);
+
+        loop {
+            let activation = ticker.wait()?;
+            self.activate(activation);
+        }
+    }
+
+    /// Run the runnables released at the base tick of the activation.
+    ///
+    /// The release of the activation is the latest base tick that passed, see
+    /// [Activation]; the releases of the missed base ticks before it are
+    /// skipped.
+    pub fn activate(&mut self, activation: Activation) {
+        let tick = activation.release.ticks() / self.base;
+
+        if activation.missed > 0 {
+            let first_missed = tick.saturating_sub(u64::from(activation.missed));
+            for runnable in self.runnables.iter_mut() {
+                let skipped = runnable.releases_before(tick) - runnable.releases_before(first_missed);
+                let skipped = u32::try_from(skipped).unwrap_or(u32::MAX);
+                runnable.stats.skipped = runnable.stats.skipped.saturating_add(skipped);
+            }
+        }
+
+        for runnable in self.runnables.iter_mut().filter(|runnable| runnable.is_due(tick)) {
+            runnable.run();
+        }
+    }
+
+    /// Returns the timing of the runnable with the given index.
+    pub fn stats(&self, index: usize) -> Option<RunnableStats> {
+        self.runnables.get(index).map(|runnable| runnable.stats)
+    }
+
+    /// Convert a duration to base ticks, if it is a multiple of the base rate.
+    fn base_ticks(&self, duration: Duration) -> Option<u64> {
+        let ticks = duration_to_stm_ticks(duration)?;
+        (ticks % self.base == 0).then_some(ticks / self.base)
+    }
+}
+
+/// Greatest common divisor.
+const fn gcd(mut a: u64, mut b: u64) -> u64 {
+    while b != 0 {
+        (a, b) = (b, a % b);
+    }
+    a
+}
+
+#[cfg(test)]
+mod tests {
+    use core::time::Duration;
+
+    use super::{ScheduleError, ScheduleTable};
+    use crate::pxros::periodic::Schedule;
+    use crate::pxros::time::{host, Instant};
+
+    const MS: u64 = 100_000;
+
+    fn base_rate() -> Schedule {
+        Schedule::new(Duration::from_millis(1), Instant::from_ticks(0))
+    }
+
+    #[test]
+    fn runnables_run_at_their_offsets() {
+        let mut fast = 0;
+        let mut slow = 0;
+        let mut count_fast = || fast += 1;
+        let mut count_slow = || slow += 1;
+
+        let mut table = ScheduleTable::<2>::new(Duration::from_millis(1));
+        let budget = Duration::from_millis(1);
+        table
+            .add("fast", Duration::from_millis(2), Duration::ZERO, budget, &mut count_fast)
+            .unwrap();
+        let offset = table.spread_offset(Duration::from_millis(4));
+        assert_eq!(offset, Duration::from_millis(1));
+        table
+            .add("slow", Duration::from_millis(4), offset, budget, &mut count_slow)
+            .unwrap();
+
+        let mut schedule = base_rate();
+        for tick in 0..9 {
+            table.activate(schedule.activate(Instant::from_ticks(tick * MS)));
+        }
+        // Activating during tick 11 misses ticks 9 and 10, skipping one release
+        // of each runnable
+        let activation = schedule.activate(Instant::from_ticks(11 * MS + MS / 2));
+        assert_eq!(activation.release, Instant::from_ticks(11 * MS));
+        assert_eq!(activation.missed, 2);
+        table.activate(activation);
+
+        assert_eq!(table.stats(0).unwrap().activations, 5);
+        assert_eq!(table.stats(0).unwrap().skipped, 1);
+        assert_eq!(table.stats(1).unwrap().activations, 2);
+        assert_eq!(table.stats(1).unwrap().skipped, 1);
+        drop(table);
+        assert_eq!((fast, slow), (5, 2));
+    }
+
+    #[test]
+    fn execution_time_is_checked_against_the_budget() {
+        let mut slow_job = || host::advance(Duration::from_micros(300));
+
+        let mut table = ScheduleTable::<1>::new(Duration::from_millis(1));
+        table
+            .add("slow", Duration::from_millis(1), Duration::ZERO, Duration::from_micros(200), &mut slow_job)
+            .unwrap();
+        table.activate(base_rate().activate(Instant::from_ticks(0)));
+
+        let stats = table.stats(0).unwrap();
+        assert!(stats.worst_execution >= Duration::from_micros(300));
+        assert_eq!(stats.budget_overruns, 1);
+    }
+
+    #[test]
+    fn invalid_runnables_are_rejected() {
+        let mut first = || {};
+        let mut second = || {};
+        let mut table = ScheduleTable::<1>::new(Duration::from_millis(1));
+
+        let result = table.add("job", Duration::from_micros(1500), Duration::ZERO, Duration::ZERO, &mut first);
+        assert_eq!(result, Err(ScheduleError::InvalidPeriod));
+        let result = table.add("job", Duration::from_millis(2), Duration::from_millis(2), Duration::ZERO, &mut second);
+        assert_eq!(result, Err(ScheduleError::InvalidOffset));
+    }
+}
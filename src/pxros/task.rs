@@ -7,6 +7,7 @@ use pxros::bindings::*;
 use pxros::mem::{MemoryRegion, Privileges, StackSpec};
 use pxros::PxResult;
 
+use super::delay::{discard_stale_cache, release_cached};
 use super::name_server::TaskName;
 
 /// Trait defining a PXROS task.
@@ -261,10 +262,12 @@ pub trait PxrosTask {
     ///
     /// Override this function to customize the entrypoint of the task.
     ///
-    /// Defaults to registering the [`Self::task_name`] before executing [`Self::task_main`].
+    /// Defaults to registering the [`Self::task_name`] before executing [`Self::task_main`],
+    /// and to releasing the [cached delays](super::delay::sleep_cached) of the task id around it.
     extern "C" fn entry_function(task: PxTask_t, mailbox: PxMbx_t, _activation_events: PxEvents_t) {
         let (task_debug_name, current_task_id) = log_id::<Self>();
         defmt::debug!("[{}: {}] Starting execution.", task_debug_name, current_task_id);
+        discard_stale_cache();
 
         if let Some(task_name) = Self::task_name() {
             defmt::debug!("[{}: {}] Registering to NameServer.", task_debug_name, current_task_id);
@@ -281,6 +284,7 @@ pub trait PxrosTask {
                 defmt::error!("[{}: {}] Terminated with error: {:?}", task_debug_name, current_task_id, error);
             },
         }
+        release_cached();
     }
 
     /// Generates the task's [`PxTaskSpec_T`].
@@ -1,16 +1,18 @@
 //! Abstraction over Pxros ticker API.
 
 use core::pin::Pin;
-use core::task::{Context, Poll};
+use core::task::{ready, Context, Poll};
 use core::time::Duration;
 
-use futures::{pin_mut, FutureExt, Stream, StreamExt};
-use pxros::bindings::{PxEvents_t, PxOpool_t, PxPeRelease, PxPeRequest, PxPeStart, PxPe_t};
+use futures::{pin_mut, Stream, StreamExt};
+use pxros::bindings::{PxEvents_t, PxOpool_t, PxPeRelease, PxPeRequest, PxPeStart, PxPeStop, PxPe_t, PxTicks_t};
 use pxros::PxResult;
 
+use super::delay::sleep_cached;
 use super::events::{Event, Receiver};
-use crate::pxros::executor::local_data::wait_for_event;
-use crate::pxros::time::duration_to_ticks;
+use crate::executor::budget::poll_budgeted;
+use crate::pxros::executor::local_data::PxrosData;
+use crate::pxros::time::{current_ticks, duration_to_ticks, ticks_reached, Instant};
 
 /// A ticker that "ticks" at a frequency.
 ///
@@ -52,11 +54,11 @@ impl<E: Event> Ticker<E> {
 
     /// Waits for a one-shot delay job to complete.
     ///
-    /// This may return error if [PxPeRequest] or [PxPeStart] fails.
+    /// This reuses the timeout object cached for the calling task, see
+    /// [sleep_cached] for details and failure reasons; for a delay of its own,
+    /// refer to [Delay](crate::pxros::delay::Delay).
     pub fn after(event: E, duration: Duration) -> PxResult<()> {
-        Self::every(event, duration).map(|mut ticker| {
-            ticker.wait();
-        })
+        sleep_cached(event, duration)
     }
 
     /// Waits for the next tick event in blocking manner.
@@ -68,6 +70,16 @@ impl<E: Event> Ticker<E> {
         }
     }
 
+    /// Restarts the ticker, so the next tick occurs one period from now.
+    ///
+    /// This may return error if [PxPeStop] or [PxPeStart] fails.
+    pub fn restart(&mut self) -> PxResult<()> {
+        // Safety: PxPe_t known to be a valid object.
+        PxResult::from(unsafe { PxPeStop(self.handle) })?;
+        // Safety: PxPe_t known to be a valid object.
+        PxResult::from(unsafe { PxPeStart(self.handle) })
+    }
+
     /// Returns the event owned by the ticker
     pub const fn event(&self) -> E {
         self.event
@@ -84,11 +96,50 @@ impl<E: Event> Drop for Ticker<E> {
     }
 }
 
+/// How an [AsyncTicker] catches up on ticks missed by a slow consumer.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default, defmt::Format)]
+pub enum OverrunPolicy {
+    /// Yield every missed tick on its own, right away, then continue with the
+    /// original schedule.
+    #[default]
+    Burst,
+    /// Yield the missed ticks at once, as one item counting all of them, then
+    /// continue with the original schedule.
+    Skip,
+    /// Yield the missed ticks at once, like [OverrunPolicy::Skip], then restart
+    /// the schedule so the next tick occurs one period later.
+    Delay,
+}
+
 /// Async variant of [Ticker].
 ///
-/// This ticker implements [Stream] for async usage.
+/// This ticker implements [Stream] for async usage; each item is the number of
+/// periods elapsed since the previous one. The event only wakes the consumer;
+/// the elapsed periods are computed from the tick count, so ticks occurring
+/// while the consumer is busy, or merged by the kernel while the executor is
+/// polling, are not lost. They are handled according to the [OverrunPolicy].
+///
+/// The ideal release time of the last tick yielded is kept on the
+/// [global timebase](Instant), e.g. to measure the response time of a job
+/// with a [DeadlineMonitor](crate::pxros::monitor::DeadlineMonitor); see
+/// [AsyncTicker::release].
 pub struct AsyncTicker<E: Event> {
     ticker: Ticker<E>,
+    policy: OverrunPolicy,
+    /// Period of the ticker, in kernel ticks.
+    period: PxTicks_t,
+    /// Tick count at which the next tick is due.
+    next: PxTicks_t,
+    /// Period of the ticker.
+    frequency: Duration,
+    /// Ideal release time of the last tick yielded.
+    release: Instant,
+    /// Ideal release time of the next tick.
+    next_release: Instant,
+    /// Missed ticks still to be yielded, see [OverrunPolicy::Burst].
+    backlog: u32,
+    /// Ticks missed since the ticker was started.
+    overruns: u32,
 }
 
 impl<E: Event + Unpin> AsyncTicker<E> {
@@ -96,13 +147,52 @@ impl<E: Event + Unpin> AsyncTicker<E> {
     ///
     /// See [Ticker::every] for details.
     pub fn every(event: E, frequency: Duration) -> PxResult<Self> {
+        // Read before starting, so the ticks are never expected later than
+        // they occur
+        let start = current_ticks();
+        let started = Instant::now();
         let ticker = Ticker::every(event, frequency)?;
-        Ok(Self { ticker })
+        let period = PxTicks_t(duration_to_ticks(frequency).0.max(1));
+        Ok(Self {
+            ticker,
+            policy: OverrunPolicy::default(),
+            period,
+            next: PxTicks_t(start.0.wrapping_add(period.0)),
+            frequency,
+            release: started,
+            next_release: started + frequency,
+            backlog: 0,
+            overruns: 0,
+        })
+    }
+
+    /// Set how missed ticks are handled, [OverrunPolicy::Burst] by default.
+    pub fn with_overrun_policy(mut self, policy: OverrunPolicy) -> Self {
+        self.policy = policy;
+        self
+    }
+
+    /// Returns the number of ticks missed since the ticker was started.
+    ///
+    /// A tick is missed if it occurs while the previous one was not consumed yet.
+    pub const fn overruns(&self) -> u32 {
+        self.overruns
+    }
+
+    /// Returns the ideal release time of the last tick yielded, or the start of
+    /// the ticker before the first one.
+    ///
+    /// The release is derived from the start of the ticker and its period; the
+    /// latency of the kernel timer and of the executor until the tick is yielded
+    /// is not included.
+    pub const fn release(&self) -> Instant {
+        self.release
     }
 
     /// Asynchronously wait for a one-shot delay job to complete.
     ///
-    /// See [Ticker::after] for details.
+    /// See [Ticker::after] for details; [sleep](crate::pxros::timer::sleep) does
+    /// the same without a kernel object and event of its own.
     pub async fn after(event: E, duration: Duration) -> PxResult<()> {
         let ticker = AsyncTicker::every(event, duration)?;
         pin_mut!(ticker);
@@ -110,15 +200,69 @@ impl<E: Event + Unpin> AsyncTicker<E> {
         StreamExt::next(&mut ticker).await;
         Ok(())
     }
+
+    /// Poll for the next tick, see [Stream::poll_next].
+    fn poll_tick(&mut self, context: &mut Context<'_>) -> Poll<Option<u32>> {
+        if self.backlog > 0 {
+            self.backlog -= 1;
+            self.release += self.frequency;
+            return Poll::Ready(Some(1));
+        }
+
+        // A stale event may wake us before the tick is due
+        let now = loop {
+            let now = current_ticks();
+            if ticks_reached(self.next, now) {
+                break now;
+            }
+            ready!(PxrosData::access(|data| data.poll_event(self.ticker.event()), context));
+        };
+
+        let elapsed = now.0.wrapping_sub(self.next.0) / self.period.0 + 1;
+        self.next = PxTicks_t(self.next.0.wrapping_add(elapsed.wrapping_mul(self.period.0)));
+        let first = self.next_release;
+        self.release = first + self.frequency * (elapsed - 1);
+        self.next_release = self.release + self.frequency;
+
+        let missed = elapsed - 1;
+        if missed > 0 {
+            defmt::trace!("Ticker missed {} ticks", missed);
+            self.overruns = self.overruns.saturating_add(missed);
+        }
+
+        let item = match self.policy {
+            OverrunPolicy::Burst => {
+                // The missed ticks are yielded in order, starting with the first
+                self.backlog = missed;
+                self.release = first;
+                1
+            },
+            OverrunPolicy::Skip => elapsed,
+            OverrunPolicy::Delay => {
+                if missed > 0 {
+                    let start = current_ticks();
+                    let started = Instant::now();
+                    match self.ticker.restart() {
+                        Ok(()) => {
+                            self.next = PxTicks_t(start.0.wrapping_add(self.period.0));
+                            self.next_release = started + self.frequency;
+                        },
+                        Err(error) => defmt::error!("Failed to restart the ticker: {}", error),
+                    }
+                }
+                elapsed
+            },
+        };
+
+        Poll::Ready(Some(item))
+    }
 }
 
 impl<E: Event + Unpin> Stream for AsyncTicker<E> {
-    type Item = ();
+    type Item = u32;
 
     fn poll_next(self: Pin<&mut Self>, context: &mut Context<'_>) -> Poll<Option<Self::Item>> {
-        let future = wait_for_event(self.ticker.event());
-        pin_mut!(future);
-
-        future.poll_unpin(context).map(Some)
+        let this = self.get_mut();
+        poll_budgeted(context, |context| this.poll_tick(context))
     }
 }
@@ -1,10 +1,20 @@
 //! Time utilities.
+//!
+//! Kernel time, see [time_since_boot], advances with the PXROS tick, e.g. every
+//! millisecond. For finer measurements, [Instant] reads the System Timer (STM)
+//! with a resolution of [STM_FREQUENCY].
+use core::ops::{Add, AddAssign, Sub, SubAssign};
 use core::time::Duration;
 
-use pxros::bindings::{PxTickGetTicksFromMilliSeconds, PxTickGetTimeInMilliSeconds, PxTicks_t};
+use pxros::bindings::{PxTickGetCount, PxTickGetTicksFromMilliSeconds, PxTickGetTimeInMilliSeconds, PxTicks_t};
 
 /// Returns the [`Duration`] since boot.
+///
+/// Like [current_ticks], this restores the tick suppressed by the tickless idle
+/// of the BSP first.
 pub fn time_since_boot() -> Duration {
+    resume_ticks();
+
     // Safety:
     // Documentation states no conditions for function call and returned type is primitive type (u32).
     let px_milliseconds = unsafe { PxTickGetTimeInMilliSeconds() };
@@ -19,3 +29,260 @@ pub fn duration_to_ticks(duration: Duration) -> PxTicks_t {
     // Returned type is wrapped primitive, no safety concerns there.
     unsafe { PxTickGetTicksFromMilliSeconds(duration.as_millis() as u32) }
 }
+
+/// Returns the number of kernel ticks since boot.
+///
+/// With the tickless idle of the BSP, the tick suppressed while the core idled
+/// is restored first, see `TicksResume`.
+pub fn current_ticks() -> PxTicks_t {
+    resume_ticks();
+
+    // Safety:
+    // Documentation states no conditions for function call and returned type is primitive type (u32).
+    unsafe { PxTickGetCount() }
+}
+
+/// Restore the kernel ticks suppressed while the current core idled.
+#[cfg(target_arch = "tricore")]
+fn resume_ticks() {
+    extern "C" {
+        fn TicksResume();
+    }
+
+    // Safety: the BSP function has no conditions, it only makes a handler call
+    // if the tick of the current core is suppressed.
+    unsafe { TicksResume() };
+}
+
+/// The tick is never suppressed on other targets, e.g. the host.
+#[cfg(not(target_arch = "tricore"))]
+fn resume_ticks() {}
+
+/// Checks whether the tick count `now` reached `deadline`.
+///
+/// Tick counts wrap around; deadlines must be less than half the range of the
+/// counter ahead.
+pub const fn ticks_reached(deadline: PxTicks_t, now: PxTicks_t) -> bool {
+    (now.0.wrapping_sub(deadline.0) as i32) >= 0
+}
+
+/// Frequency of the System Timer in Hz, see `UC_STM_CLOCK` in the BSP.
+pub const STM_FREQUENCY: u64 = 100_000_000;
+
+const NANOS_PER_SECOND: u64 = 1_000_000_000;
+
+/// Converts a number of System Timer ticks to a [`Duration`].
+pub const fn stm_ticks_to_duration(ticks: u64) -> Duration {
+    let nanos = (ticks % STM_FREQUENCY) * NANOS_PER_SECOND / STM_FREQUENCY;
+    Duration::new(ticks / STM_FREQUENCY, nanos as u32)
+}
+
+/// Converts a [`Duration`] to System Timer ticks, rounding down.
+///
+/// Returns `None` on overflow.
+pub const fn duration_to_stm_ticks(duration: Duration) -> Option<u64> {
+    let Some(ticks) = duration.as_secs().checked_mul(STM_FREQUENCY) else {
+        return None;
+    };
+    ticks.checked_add(duration.subsec_nanos() as u64 * STM_FREQUENCY / NANOS_PER_SECOND)
+}
+
+/// A measurement of the 64-bit System Timer, counting since reset.
+///
+/// Instants are monotonic and share one domain across all cores: each core
+/// reads its own STM, corrected by the offset to `STM0` that `InitTask`
+/// calibrates at boot. So timestamps taken on different cores, e.g. when
+/// sending and receiving a message, can be compared. At [STM_FREQUENCY] the
+/// counter wraps after thousands of years, so arithmetic does not need to care.
+///
+/// ```ignore
+/// let start = Instant::now();
+/// process();
+/// defmt::info!("Processing took {} ns", start.elapsed().as_nanos());
+/// ```
+///
+/// ## Note
+/// The timer is read directly, so the task needs the
+/// [DirectAccess](pxros::mem::Privileges::DirectAccess) privileges and read
+/// access to the STM module of its core in its memory regions. On other targets than the
+/// TriCore, a software stand-in is used, see [host].
+#[derive(Debug, Clone, Copy, PartialEq, Eq, PartialOrd, Ord, Hash, defmt::Format)]
+pub struct Instant {
+    ticks: u64,
+}
+
+impl Instant {
+    /// Returns the current instant.
+    pub fn now() -> Self {
+        Self { ticks: stm::read() }
+    }
+
+    /// Creates an instant from a raw System Timer value.
+    pub const fn from_ticks(ticks: u64) -> Self {
+        Self { ticks }
+    }
+
+    /// Returns the raw System Timer value.
+    pub const fn ticks(&self) -> u64 {
+        self.ticks
+    }
+
+    /// Returns the time elapsed since this instant.
+    pub fn elapsed(&self) -> Duration {
+        Self::now().duration_since(*self)
+    }
+
+    /// Returns the time elapsed from `earlier` to this instant, or zero if
+    /// `earlier` is later.
+    pub const fn duration_since(&self, earlier: Instant) -> Duration {
+        stm_ticks_to_duration(self.ticks.saturating_sub(earlier.ticks))
+    }
+
+    /// Returns the time elapsed from `earlier` to this instant, or `None` if
+    /// `earlier` is later.
+    pub const fn checked_duration_since(&self, earlier: Instant) -> Option<Duration> {
+        match self.ticks.checked_sub(earlier.ticks) {
+            Some(ticks) => Some(stm_ticks_to_duration(ticks)),
+            None => None,
+        }
+    }
+
+    /// Returns the instant `duration` later, or `None` on overflow.
+    pub const fn checked_add(&self, duration: Duration) -> Option<Instant> {
+        let Some(ticks) = duration_to_stm_ticks(duration) else {
+            return None;
+        };
+        match self.ticks.checked_add(ticks) {
+            Some(ticks) => Some(Instant { ticks }),
+            None => None,
+        }
+    }
+
+    /// Returns the instant `duration` earlier, or `None` on underflow.
+    pub const fn checked_sub(&self, duration: Duration) -> Option<Instant> {
+        let Some(ticks) = duration_to_stm_ticks(duration) else {
+            return None;
+        };
+        match self.ticks.checked_sub(ticks) {
+            Some(ticks) => Some(Instant { ticks }),
+            None => None,
+        }
+    }
+}
+
+impl Add<Duration> for Instant {
+    type Output = Instant;
+
+    /// # Panics
+    /// This will panic on overflow, see [Instant::checked_add].
+    fn add(self, duration: Duration) -> Instant {
+        self.checked_add(duration)
+            .expect("Overflow when adding duration to instant")
+    }
+}
+
+impl AddAssign<Duration> for Instant {
+    fn add_assign(&mut self, duration: Duration) {
+        *self = *self + duration;
+    }
+}
+
+impl Sub<Duration> for Instant {
+    type Output = Instant;
+
+    /// # Panics
+    /// This will panic on underflow, see [Instant::checked_sub].
+    fn sub(self, duration: Duration) -> Instant {
+        self.checked_sub(duration)
+            .expect("Overflow when subtracting duration from instant")
+    }
+}
+
+impl SubAssign<Duration> for Instant {
+    fn sub_assign(&mut self, duration: Duration) {
+        *self = *self - duration;
+    }
+}
+
+impl Sub<Instant> for Instant {
+    type Output = Duration;
+
+    /// Saturates to zero, see [Instant::duration_since].
+    fn sub(self, earlier: Instant) -> Duration {
+        self.duration_since(earlier)
+    }
+}
+
+/// Access to the global timebase of the BSP, see `TimebaseNow`.
+#[cfg(target_arch = "tricore")]
+mod stm {
+    extern "C" {
+        fn TimebaseNow() -> u64;
+    }
+
+    /// Reads the System Timer of the current core, corrected to the domain of
+    /// `STM0` by the offset calibrated at boot.
+    pub(super) fn read() -> u64 {
+        // Safety: the BSP function has no conditions; the STM of the current core
+        // is readable given the access rights documented on `Instant`.
+        unsafe { TimebaseNow() }
+    }
+}
+
+/// Software stand-in for the System Timer on other targets, e.g. the host.
+///
+/// The timer only advances when told to, so code depending on [Instant] can be
+/// tested deterministically.
+#[cfg(not(target_arch = "tricore"))]
+pub mod host {
+    use core::sync::atomic::{AtomicU64, Ordering};
+    use core::time::Duration;
+
+    use super::duration_to_stm_ticks;
+
+    static TICKS: AtomicU64 = AtomicU64::new(0);
+
+    /// Advances the timer by the given duration.
+    ///
+    /// # Panics
+    /// This will panic if the duration overflows the timer.
+    pub fn advance(duration: Duration) {
+        let ticks = duration_to_stm_ticks(duration).expect("Duration overflows the timer");
+        TICKS.fetch_add(ticks, Ordering::Relaxed);
+    }
+
+    pub(super) fn read() -> u64 {
+        TICKS.load(Ordering::Relaxed)
+    }
+}
+
+#[cfg(not(target_arch = "tricore"))]
+use host as stm;
+
+#[cfg(test)]
+mod tests {
+    use core::time::Duration;
+
+    use super::{duration_to_stm_ticks, host, stm_ticks_to_duration, Instant, STM_FREQUENCY};
+
+    #[test]
+    fn conversions_round_trip() {
+        let duration = Duration::new(3, 123_456_780);
+        let ticks = duration_to_stm_ticks(duration).unwrap();
+
+        assert_eq!(ticks, 3 * STM_FREQUENCY + 12_345_678);
+        assert_eq!(stm_ticks_to_duration(ticks), duration);
+        assert_eq!(duration_to_stm_ticks(Duration::MAX), None);
+    }
+
+    #[test]
+    fn instants_follow_the_timer() {
+        let start = Instant::now();
+        host::advance(Duration::from_micros(250));
+
+        assert!(start.elapsed() >= Duration::from_micros(250));
+        assert_eq!(start + Duration::from_micros(250) - start, Duration::from_micros(250));
+        assert_eq!(start - (start + Duration::from_nanos(10)), Duration::ZERO);
+        assert_eq!(Instant::from_ticks(0).checked_sub(Duration::from_nanos(10)), None);
+    }
+}
@@ -0,0 +1,77 @@
+//! Async timers multiplexed onto a single kernel timer per executor.
+//!
+//! Unlike [AsyncTicker](crate::pxros::ticker::AsyncTicker), these timers do not
+//! need a kernel object or an [Event](crate::pxros::events::Event) of their own:
+//! the [PxrosExecutor](crate::pxros::executor::PxrosExecutor) keeps the
+//! deadlines of its tasks and arms a single one-shot object for the earliest
+//! one, requested on first use.
+//!
+//! ```ignore
+//! async fn blink() {
+//!     loop {
+//!         toggle_led();
+//!         sleep(Duration::from_millis(500)).await;
+//!     }
+//! }
+//!
+//! async fn request() -> Result<RawMessage, Elapsed> {
+//!     with_timeout(Duration::from_millis(100), wait_for_message()).await
+//! }
+//! ```
+use core::future::{poll_fn, Future};
+use core::task::Poll;
+use core::time::Duration;
+
+use futures::pin_mut;
+use pxros::bindings::PxTicks_t;
+
+use super::executor::local_data::PxrosData;
+use super::time::{current_ticks, duration_to_ticks, time_since_boot};
+
+/// Error returned by [with_timeout] if the future did not complete in time.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, defmt::Format)]
+pub struct Elapsed;
+
+/// Compute the deadline lying the given duration ahead.
+fn deadline_after(duration: Duration) -> PxTicks_t {
+    PxTicks_t(current_ticks().0.wrapping_add(duration_to_ticks(duration).0))
+}
+
+/// Wait until the given tick count was reached.
+async fn wait_until(deadline: PxTicks_t) {
+    poll_fn(|cx| PxrosData::access(|data| data.poll_deadline(deadline, current_ticks()), cx)).await
+}
+
+/// Asynchronously wait for the given duration.
+///
+/// The duration is rounded to kernel ticks; the task is woken on the first
+/// tick at or after the deadline.
+pub async fn sleep(duration: Duration) {
+    wait_until(deadline_after(duration)).await
+}
+
+/// Asynchronously wait until the given time since boot.
+///
+/// Returns immediately if the time lies in the past, see [time_since_boot].
+pub async fn sleep_until(since_boot: Duration) {
+    sleep(since_boot.saturating_sub(time_since_boot())).await
+}
+
+/// Run a future, giving up after the given duration.
+///
+/// The future is polled first, so one that is ready right away always
+/// completes, even with a zero duration; it is dropped once the deadline was
+/// reached.
+pub async fn with_timeout<F: Future>(duration: Duration, future: F) -> Result<F::Output, Elapsed> {
+    let deadline = deadline_after(duration);
+    pin_mut!(future);
+
+    poll_fn(|cx| {
+        if let Poll::Ready(output) = future.as_mut().poll(cx) {
+            return Poll::Ready(Ok(output));
+        }
+
+        PxrosData::access(|data| data.poll_deadline(deadline, current_ticks()), cx).map(|()| Err(Elapsed))
+    })
+    .await
+}
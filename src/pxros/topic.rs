@@ -0,0 +1,363 @@
+//! Publish/subscribe topics with shared sample buffers.
+//!
+//! A [Topic] owns `N` buffers for samples of a [Plain] type. Publishing writes a
+//! sample once into a free buffer and hands it to every subscriber, which reads
+//! it in place: fanning a sample out costs one copy regardless of the number of
+//! subscribers. Buffers are reference counted and return to the topic once the
+//! publisher and the last subscriber are done with them.
+//!
+//! ```ignore
+//! static SPEED: Topic<Speed, 7, 3> = Topic::new();
+//!
+//! // Publisher
+//! SPEED.publish(Speed { rpm: read_rpm() })?;
+//!
+//! // Subscriber, on any core
+//! let mut speed = SPEED.subscribe(AsyncEvent::SPEED)?;
+//! loop {
+//!     let sample = speed.next().await;
+//!     defmt::info!("{} rpm", sample.rpm);
+//! }
+//! ```
+//!
+//! Subscribers always get the latest sample: one published before the previous
+//! was taken replaces it, see [Subscription::skipped].
+//!
+//! ## Note
+//! The topic must be placed in memory readable by all subscribers and writable
+//! by the publishers, in their memory regions.
+
+use core::cell::UnsafeCell;
+use core::mem::MaybeUninit;
+use core::ops::Deref;
+use core::sync::atomic::{fence, AtomicU32, Ordering};
+
+use pxros::bindings::{PxError_t, PxEvents_t, PxGetId, PxTaskSignalEvents, PxTask_t};
+use pxros::PxResult;
+
+use super::events::{Event, Receiver};
+use super::executor::local_data::wait_for_event;
+use super::messages::Plain;
+
+/// A sample buffer of a [Topic].
+struct Buffer<T> {
+    /// Publisher and subscribers holding the buffer; free if zero.
+    references: AtomicU32,
+    sample: UnsafeCell<MaybeUninit<T>>,
+}
+
+/// A subscriber of a [Topic].
+struct Subscriber {
+    /// Raw id of the subscribing task, 0 if free.
+    task: AtomicU32,
+    /// Events signalled to the task on publication, none if zero.
+    events: AtomicU32,
+    /// Index of the buffer with the latest sample plus one, 0 if none.
+    pending: AtomicU32,
+    /// Samples replaced before they were taken.
+    skipped: AtomicU32,
+}
+
+/// A topic distributing samples to up to `S` subscribers, through `N` buffers.
+///
+/// A subscriber reading one sample at a time holds at most two buffers, the
+/// pending sample and the one it reads, and a publication one more; with `N`
+/// at least `2 * S + 1`, publishing then never runs out of buffers.
+///
+/// See the [module](self) documentation for details.
+pub struct Topic<T: Plain, const N: usize, const S: usize> {
+    buffers: [Buffer<T>; N],
+    subscribers: [Subscriber; S],
+}
+
+// Safety: the samples are only written while the buffer is held by the
+// publisher alone, and only read while held; see Topic::publish_with.
+unsafe impl<T: Plain, const N: usize, const S: usize> Sync for Topic<T, N, S> {}
+
+impl<T: Plain, const N: usize, const S: usize> Topic<T, N, S> {
+    /// Allows us to create an array of buffers even if they are not copy.
+    #[allow(clippy::declare_interior_mutable_const)]
+    const FREE_BUFFER: Buffer<T> = Buffer {
+        references: AtomicU32::new(0),
+        // Any bit pattern, including zeros, is a valid value of a Plain type
+        sample: UnsafeCell::new(MaybeUninit::zeroed()),
+    };
+    /// Allows us to create an array of subscribers even if they are not copy.
+    #[allow(clippy::declare_interior_mutable_const)]
+    const FREE_SUBSCRIBER: Subscriber = Subscriber {
+        task: AtomicU32::new(0),
+        events: AtomicU32::new(0),
+        pending: AtomicU32::new(0),
+        skipped: AtomicU32::new(0),
+    };
+
+    /// Create a topic without subscribers.
+    pub const fn new() -> Self {
+        Self {
+            buffers: [Self::FREE_BUFFER; N],
+            subscribers: [Self::FREE_SUBSCRIBER; S],
+        }
+    }
+
+    /// Publish a sample to all current subscribers.
+    ///
+    /// See [Topic::publish_with] for details.
+    pub fn publish(&self, sample: T) -> PxResult<()> {
+        self.publish_with(|buffer| *buffer = sample)
+    }
+
+    /// Publish a sample written in place by `write` to all current subscribers,
+    /// signalling their events.
+    ///
+    /// The buffer passed to `write` holds an older sample, so all fields need
+    /// to be written. Returns [PxError_t::PXERR_GLOBAL_OBJLIST_EMPTY] if no
+    /// buffer is free.
+    pub fn publish_with(&self, write: impl FnOnce(&mut T)) -> PxResult<()> {
+        let index = self
+            .buffers
+            .iter()
+            .position(|buffer| {
+                buffer
+                    .references
+                    .compare_exchange(0, 1, Ordering::Acquire, Ordering::Relaxed)
+                    .is_ok()
+            })
+            .ok_or(PxError_t::PXERR_GLOBAL_OBJLIST_EMPTY)?;
+
+        // Safety: the buffer is held by the publisher alone; any bit pattern is
+        // a valid value of the type.
+        write(unsafe { (*self.buffers[index].sample.get()).assume_init_mut() });
+
+        let mut result = Ok(());
+        for subscriber in self.subscribers.iter() {
+            let task = subscriber.task.load(Ordering::Acquire);
+            if task == 0 {
+                continue;
+            }
+
+            self.buffers[index].references.fetch_add(1, Ordering::Relaxed);
+            let replaced = subscriber.pending.swap(index as u32 + 1, Ordering::AcqRel);
+            if replaced != 0 {
+                subscriber.skipped.fetch_add(1, Ordering::Relaxed);
+                self.release(replaced as usize - 1);
+            }
+
+            let events = subscriber.events.load(Ordering::Relaxed);
+            if events != 0 {
+                // Safety: this is safe to call only from tasks.
+                let signalled = unsafe { PxTaskSignalEvents(PxTask_t::from_raw(task), PxEvents_t(events)) };
+                result = result.and(PxResult::from(signalled));
+            }
+        }
+
+        self.release(index);
+        result
+    }
+
+    /// Subscribe the calling task to the samples published from now on; the
+    /// event is signalled to it on every publication.
+    ///
+    /// Returns [PxError_t::PXERR_GLOBAL_OBJLIST_EMPTY] if the topic has `S`
+    /// subscribers already.
+    pub fn subscribe<E: Event>(&'static self, event: E) -> PxResult<Subscription<T, N, S, E>> {
+        let index = self
+            .attach(PxGetId().as_raw(), event.bits())
+            .ok_or(PxError_t::PXERR_GLOBAL_OBJLIST_EMPTY)?;
+
+        Ok(Subscription {
+            topic: self,
+            index,
+            event,
+        })
+    }
+
+    /// Claim a free subscriber slot for the task.
+    fn attach(&self, task: u32, events: u32) -> Option<usize> {
+        let index = self.subscribers.iter().position(|subscriber| {
+            subscriber
+                .task
+                .compare_exchange(0, task, Ordering::AcqRel, Ordering::Relaxed)
+                .is_ok()
+        })?;
+
+        let subscriber = &self.subscribers[index];
+        subscriber.events.store(events, Ordering::Relaxed);
+        subscriber.skipped.store(0, Ordering::Relaxed);
+        // A publication racing with the previous subscriber may have left a sample
+        self.drop_pending(subscriber);
+        Some(index)
+    }
+
+    /// Give the subscriber slot back.
+    fn detach(&self, index: usize) {
+        let subscriber = &self.subscribers[index];
+        subscriber.task.store(0, Ordering::Release);
+        self.drop_pending(subscriber);
+    }
+
+    /// Release the pending sample of the subscriber, if any.
+    fn drop_pending(&self, subscriber: &Subscriber) {
+        let pending = subscriber.pending.swap(0, Ordering::AcqRel);
+        if pending != 0 {
+            self.release(pending as usize - 1);
+        }
+    }
+
+    /// Take the pending sample of the subscriber, if any.
+    fn take(&self, index: usize) -> Option<Sample<'_, T, N, S>> {
+        let pending = self.subscribers[index].pending.swap(0, Ordering::AcqRel);
+        (pending != 0).then(|| Sample {
+            topic: self,
+            buffer: pending as usize - 1,
+        })
+    }
+
+    /// Drop a reference to the buffer, freeing it with the last one.
+    fn release(&self, index: usize) {
+        if self.buffers[index].references.fetch_sub(1, Ordering::Release) == 1 {
+            // Reads of the sample happen before the buffer is claimed again
+            fence(Ordering::Acquire);
+        }
+    }
+}
+
+impl<T: Plain, const N: usize, const S: usize> Default for Topic<T, N, S> {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+/// A sample of a [Topic], read in place.
+///
+/// The buffer returns to the topic once the last holder drops it.
+pub struct Sample<'a, T: Plain, const N: usize, const S: usize> {
+    topic: &'a Topic<T, N, S>,
+    buffer: usize,
+}
+
+impl<T: Plain, const N: usize, const S: usize> Deref for Sample<'_, T, N, S> {
+    type Target = T;
+
+    fn deref(&self) -> &T {
+        // Safety: the buffer is held, so it is not written; any bit pattern is
+        // a valid value of the type.
+        unsafe { (*self.topic.buffers[self.buffer].sample.get()).assume_init_ref() }
+    }
+}
+
+impl<T: Plain, const N: usize, const S: usize> Drop for Sample<'_, T, N, S> {
+    fn drop(&mut self) {
+        self.topic.release(self.buffer)
+    }
+}
+
+/// Subscription of a task to a [Topic], see [Topic::subscribe].
+///
+/// The subscription ends once dropped.
+pub struct Subscription<T: Plain + 'static, const N: usize, const S: usize, E: Event> {
+    topic: &'static Topic<T, N, S>,
+    index: usize,
+    event: E,
+}
+
+impl<T: Plain, const N: usize, const S: usize, E: Event> Subscription<T, N, S, E> {
+    /// Take the latest sample published since the last one was taken, if any.
+    pub fn try_receive(&mut self) -> Option<Sample<'static, T, N, S>> {
+        self.topic.take(self.index)
+    }
+
+    /// Wait in blocking manner for the next sample.
+    pub fn receive(&mut self) -> Sample<'static, T, N, S> {
+        loop {
+            if let Some(sample) = self.try_receive() {
+                return sample;
+            }
+
+            // The event may stem from a sample already taken; check again
+            Receiver::await_events(self.event);
+        }
+    }
+
+    /// Asynchronously wait for the next sample.
+    pub async fn next(&mut self) -> Sample<'static, T, N, S> {
+        loop {
+            if let Some(sample) = self.try_receive() {
+                return sample;
+            }
+
+            // The event may stem from a sample already taken; check again
+            wait_for_event(self.event).await;
+        }
+    }
+
+    /// Returns the number of samples replaced by a newer one before they were
+    /// taken.
+    pub fn skipped(&self) -> u32 {
+        self.topic.subscribers[self.index].skipped.load(Ordering::Relaxed)
+    }
+}
+
+impl<T: Plain, const N: usize, const S: usize, E: Event> Drop for Subscription<T, N, S, E> {
+    fn drop(&mut self) {
+        self.topic.detach(self.index)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use core::sync::atomic::Ordering;
+
+    use super::Topic;
+
+    fn free_buffers<const N: usize, const S: usize>(topic: &Topic<u32, N, S>) -> usize {
+        topic
+            .buffers
+            .iter()
+            .filter(|buffer| buffer.references.load(Ordering::Relaxed) == 0)
+            .count()
+    }
+
+    #[test]
+    fn samples_are_shared_until_the_last_reader() {
+        // Subscribers without events are not signalled
+        let topic = Topic::<u32, 5, 2>::new();
+        let first = topic.attach(1, 0).unwrap();
+        let second = topic.attach(2, 0).unwrap();
+
+        topic.publish(7).unwrap();
+        assert_eq!(free_buffers(&topic), 4);
+
+        let sample = topic.take(first).unwrap();
+        assert_eq!(*sample, 7);
+        assert!(topic.take(first).is_none());
+        drop(sample);
+        assert_eq!(free_buffers(&topic), 4);
+
+        // The pending sample of the second subscriber is replaced
+        topic.publish(8).unwrap();
+        assert_eq!(*topic.take(second).unwrap(), 8);
+        assert_eq!(topic.subscribers[second].skipped.load(Ordering::Relaxed), 1);
+
+        topic.detach(first);
+        assert_eq!(free_buffers(&topic), 5);
+    }
+
+    #[test]
+    fn publishing_fails_without_free_buffers() {
+        let topic = Topic::<u32, 2, 1>::new();
+        let subscriber = topic.attach(1, 0).unwrap();
+
+        // One buffer read, one pending
+        topic.publish(1).unwrap();
+        let held = topic.take(subscriber).unwrap();
+        topic.publish(2).unwrap();
+        assert!(topic.publish(3).is_err());
+        assert_eq!(*held, 1);
+
+        drop(held);
+        topic.publish(3).unwrap();
+        assert_eq!(*topic.take(subscriber).unwrap(), 3);
+        assert_eq!(topic.subscribers[subscriber].skipped.load(Ordering::Relaxed), 1);
+        assert!(topic.attach(2, 0).is_none());
+    }
+}
@@ -55,6 +55,14 @@ pub struct Options {
     /// This is required if the Ethernet driver is used.
     #[arg(long, required = false)]
     pub include_ethernet_task: bool,
+
+    /// Suppress the PXROS tick while a core is idle (`PX_BSP_TICKLESS`).
+    ///
+    /// Kernel timeouts expiring while idle may be processed up to
+    /// `PX_BSP_TICKLESS_MAX_IDLE_TICKS` late, and tasks made ready by other
+    /// interrupts may read a stale tick unless they call `TicksResume` first.
+    #[arg(long, required = false)]
+    pub tickless: bool,
 }
 
 /// Tricore probe log level.
@@ -158,7 +166,8 @@ pub fn build(options: Options) -> anyhow::Result<()> {
     env::set_current_dir(workspace_root_dir.join(options.app_folder))?;
 
     let build_directory = build_directory.to_str().expect("Path should be valid UTF-8.");
-    let make_result = make_pxros(build_directory, options.jobs, options.build_illd, options.include_ethernet_task);
+    let make_result =
+        make_pxros(build_directory, options.jobs, options.build_illd, options.include_ethernet_task, options.tickless);
 
     env::set_current_dir(current_directory)?;
 
@@ -184,6 +193,7 @@ fn make_pxros(
     make_job_count: usize,
     build_illd: bool,
     include_ethernet_task: bool,
+    tickless: bool,
 ) -> anyhow::Result<()> {
     let mut env_vars = vec![
         ("PXROS_ROOT_PATH", to_os_path(pxros_hr::TRI_8_2_1_EVAL_KERNEL)),
@@ -200,6 +210,10 @@ fn make_pxros(
         env_vars.push(("INCLUDE_ETHERNET_DRIVER_TASK", "1".into()));
     }
 
+    if tickless {
+        env_vars.push(("PX_BSP_TICKLESS", "1".into()));
+    }
+
     if !process::Command::new("cmake")
         .args(["-B", build_dir, "--fresh", "-G", "Unix Makefiles"])
         .envs(env_vars.clone())